@@ -1,5 +1,10 @@
 #include <iostream>         // cout, cerr
+#include <algorithm>        // upper_bound
+#include <chrono>           // picking time
 #include <cstdlib>          // EXIT_FAILURE
+#include <cmath>            // sqrt, ceil
+#include <random>           // point light placement
+#include <string>           // command line options
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #define STB_IMAGE_IMPLEMENTATION
@@ -12,15 +17,33 @@
 
 #include "./tutorial_05_04/ShapeCreator.h"
 #include "./tutorial_05_04/Mesh.h"
+#include "./tutorial_05_04/MeshStore.h"
+#include "./tutorial_05_04/MeshIndexer.h"
+#include "./tutorial_05_04/ProgramCache.h"
+#include "./tutorial_05_04/FrameProfiler.h"
+#include "./tutorial_05_04/Frustum.h"
+#include "./tutorial_05_04/GeometryPool.h"
+#include "./tutorial_05_04/HeadlessContext.h"
+#include "./tutorial_05_04/IndirectDraw.h"
+#include "./tutorial_05_04/InstanceBatch.h"
+#include "./tutorial_05_04/LightClusters.h"
+#include "./tutorial_05_04/LodSelector.h"
+#include "./tutorial_05_04/RenderQueue.h"
+#include "./tutorial_05_04/SceneBVH.h"
+#include "./tutorial_05_04/ShaderLibrary.h"
+#include "./tutorial_05_04/ShaderProgram.h"
+#include "./tutorial_05_04/ShadowMap.h"
+#include "./tutorial_05_04/StateCache.h"
+#include "./tutorial_05_04/TextureArrays.h"
+#include "./tutorial_05_04/TextureCache.h"
+#include "./tutorial_05_04/ThreadPool.h"
+#include "./tutorial_05_04/UniformBuffer.h"
+#include "./tutorial_05_04/UploadRing.h"
+#include "./tutorial_05_04/VertexFormat.h"
 #include <camera.h> // Camera class
 
 using namespace std; // Standard namespace
 
-/*Shader program Macro*/
-#ifndef GLSL
-#define GLSL(Version, Source) "#version " #Version " core \n" #Source
-#endif
-
 // Unnamed namespace
 namespace
 {
@@ -30,16 +53,103 @@ const char* const WINDOW_TITLE = "CS330 Project"; // Macro for window title
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 600;
 
+// Clip planes of both projections
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
 
-//scene to hold each shape
+//shapes as they are authored, before they are moved into the scene store
 vector<GLMesh> scene;
 
+//scene meshes: packed draw data plus a cold table of authoring data
+MeshStore gScene;
+
+//the scene as indirect commands, rebuilt only when the store changes
+IndirectDrawList gSceneDraws;
+unsigned gSceneDrawsVersion = ~0u;
+
+//shapes that are repeated with only a different transform, one instanced draw each
+vector<InstanceBatch> gInstanceBatches;
+
+//extra pens laid out on a grid, set with --pens N
+int gPenInstances = 0;
+
+//--mesh-benchmark N times the generation of cylinders with N sides and exits
+int gMeshBenchmarkSides = 0;
+
+//every scene mesh and every batch instance in one hierarchy, for culling and picking (--no-bvh
+//culls with the flat sphere test instead); objects are the scene handles followed by the
+//instances of each batch, starting at gBatchFirstObject
+SceneBVH gSceneBVH;
+bool gUseBVH = true;
+vector<size_t> gBatchFirstObject;
+vector<uint32_t> gBatchLodChain;
+vector<uint32_t> gVisibleObjects;
+vector<uint8_t> gSceneVisible;
+vector<vector<GLuint>> gBatchVisible;
+
+//level of detail of every visible object, picked from its size on screen (--no-lod draws the
+//finest level, --lod-error PX sets the allowed silhouette error, --triangle-budget N caps a frame)
+LodSelector gLods;
+bool gUseLod = true;
+float gLodError = 1.0f;
+size_t gTriangleBudget = 0;
+vector<uint8_t> gVisibleLevels;
+vector<GeometryRange> gSceneRanges;
+vector<vector<uint8_t>> gBatchLevels;
+size_t gFrameTriangles = 0;
+size_t gTrianglesDrawn = 0;
+size_t gLodFrames = 0;
+
+//layout of the pool's vertices on the GPU, set with --vertex-format float|half|unorm16
+VertexFormatId gVertexFormat = VERTEX_FORMAT_UNORM16;
+// --verify-vertex-formats packs the scene in every format, checks the error bounds and exits
+bool gVerifyVertexFormats = false;
+
+//view-frustum culling (--no-culling turns it off); draws tested and kept, summed over all frames
+bool gFrustumCulling = true;
+size_t gCullTested = 0;
+size_t gCullVisible = 0;
+
+//visible draws sorted by program, texture, vertex array and then depth every frame (--no-sort
+//keeps the build order); --depth-prepass lays down depth first so the lit pass shades each pixel
+//about once; state changes between neighbouring draws are summed before and after the sort
+RenderQueue gRenderQueue;
+bool gSortDraws = true;
+bool gDepthPrepass = false;
+vector<GLuint> gSceneOrder;
+vector<size_t> gBatchOrder;
+size_t gQueueFrames = 0;
+size_t gQueuedDraws = 0;
+size_t gStateChangesUnsorted = 0;
+size_t gStateChangesSorted = 0;
+double gQueueMilliseconds = 0.0;
+
 // Main GLFW window
 GLFWwindow* gWindow = nullptr;
-// Texture
-GLuint gTextureId;
+
+// --headless N renders N frames into an offscreen framebuffer instead of a window,
+// along a fixed camera path, then prints the frame times and exits
+int gHeadlessFrames = 0;
+HeadlessContext gHeadless;
+// --soak N is a headless run of N frames that fails when the GL objects alive at the end
+// outnumber those after the first frame
+bool gSoak = false;
+// Textures, shared by every mesh that uses the same image; the KTX2 files of the
+// texture baker are used where they exist (--no-baked-textures decodes the originals)
+TextureCache gTextures;
+bool gBakedTextures = true;
+// Image decoding runs on these so the first frame does not wait for it
+ThreadPool gWorkers;
+// Scene textures copied into arrays, so draws pick them by slot instead of binding;
+// --texture-binding batch goes back to one bind per texture
+TextureArraySet gTextureArrays;
+bool gUseTextureArrays = true;
 glm::vec2 gUVScale(5.0f, 5.0f);
 GLint gTexWrapMode = GL_REPEAT;
+// One sampler object per wrap mode, so keys 1-4 only switch which one is bound
+const GLint WRAP_MODES[] = { GL_REPEAT, GL_MIRRORED_REPEAT, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BORDER };
+GLuint gWrapSamplers[4] = {};
 
 // camera
 Camera gCamera(glm::vec3(0.0f, 10.0f, 50.0f));
@@ -50,18 +160,68 @@ bool perspective = true;
 
 // timing
 float gDeltaTime = 0.0f; // time between current frame and last frame
-float gLastFrame = 0.0f;
+double gLastFrame = 0.0; // kept in double, glfwGetTime loses float precision after a while
+
+// CPU and GPU frame times; --profile-csv FILE dumps them, --overlay shows them in the title
+FrameProfiler gProfiler;
+string gProfileCsv;
+bool gProfileOverlay = false;
 
 // Shader program
-GLuint gKeyLightId;
-GLuint gSpotLightId;
+ShaderProgram gKeyLightProgram;
+ShaderProgram gSpotLightProgram;
+ShaderProgram gInstancedProgram;
+
+// The same vertex shaders with a depth-only fragment shader, for the shadow pass
+ShaderProgram gShadowProgram;
+ShaderProgram gShadowInstancedProgram;
+ShaderProgram gShadowLampProgram;
+
+// Every program above, built from the files in shaders/ and rebuilt when one of them is
+// saved (--no-shader-reload keeps the startup build)
+ShaderLibrary gShaders;
+bool gShaderReload = true;
+
+// Linked program binaries from earlier launches, --program-cache FILE moves them and
+// --no-program-cache compiles every program from source
+ProgramCache gProgramCache;
+string gProgramCachePath = "program_cache.bin";
+bool gUseProgramCache = true;
+
+// Per-frame uniforms shared by both programs
+FrameUniformBuffer gFrameUniforms;
+
+// Persistently mapped ring every frame streams its dynamic data through, --upload-ring-kib N sizes it
+UploadRing gUploadRing;
+size_t gUploadRingKiB = 12 * 1024;
 
-GLMesh gSpotLightMesh;
+// Light and gizmo meshes, built once and only re-transformed afterwards
+MeshStore gGizmos;
+MeshStore::Handle gSpotLightGizmo;
 
 // Light color, position and scale
 glm::vec3 gKeyLightColor(1.0f, 1.0f, 1.0f);
 glm::vec3 gKeyLightPosition(0.0f, 250.0f, -250.0f);
 glm::vec3 gKeyLightScale(10.0f);
+float gKeyLightIntensity = 0.5f;
+
+// Shadow map of the key light, set with --shadow-size N, --shadow-pcf K (kernel width) and
+// --shadow-policy off|cached|always; the static casters are only re-rendered when one inside
+// the light frustum moves or the light changes, the lamp is composited over them
+ShadowMap gShadowMap;
+ShadowPolicy gShadowPolicy = SHADOW_CACHED;
+int gShadowResolution = 2048;
+int gShadowPcf = 3;
+BoundingBox gShadowArea;
+vector<BoundingBox> gShadowCasterBoxes;
+unsigned gShadowSceneVersion = ~0u;
+unsigned gShadowBatchVersion = ~0u;
+glm::mat4 gShadowLampModel(0.0f);
+
+// Point lights scattered over the scene with --lights N, shaded through a cluster grid
+vector<PointLight> gPointLights;
+LightClusters gLightClusters;
+int gPointLightCount = 0;
 
 // Light color, position and scale
 glm::vec3 gSpotLightColor(1.0f, 1.0f, 1.0f);
@@ -76,163 +236,138 @@ bool gSpotLightOrbit = true;
  * redraw graphics on the window when resized,
  * and render graphics on the screen
  */
+void UParseOptions(int argc, char* argv[]);
 bool UInitialize(int, char*[], GLFWwindow** window);
+double UGetTime();
+void UFollowBenchmarkPath(int frame);
+size_t UCountGLObjects();
+size_t UCountOwnedObjects();
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-void UDestroyMesh(GLMesh &mesh);
-void UCreateScene(vector<GLMesh>& scene);
+void UCreateScene(vector<GLMesh>& scene, vector<InstanceBatch>& batches);
+void UCreatePenField(vector<InstanceBatch>& batches, int count);
+void UCreateGizmos(MeshStore& gizmos);
+void UBenchmarkMeshes(int sides);
+void UBuildTextureArrays();
+void UBuildSceneBVH();
+void UCreatePointLights(vector<PointLight>& lights, int count);
+void UCreateShadowMap();
+void UDrawShadows(FrameData& frame);
+vector<BoundingBox> USceneObjectBounds();
+void URefitMovedObjects();
+size_t UBatchOfObject(uint32_t object);
+void UQueueDraws(const RenderStore& store, const glm::mat4& view);
+void UDrawBatches(const GeometryPool& geometry, const ShaderProgram& program);
+float ULodRadius(const MeshAuthoring& mesh, const glm::mat4& model);
+glm::mat4 UProjection();
+void UPickObject(GLFWwindow* window);
 bool UCreateTexture(const char* filename, GLuint &textureId);
 void UDestroyTexture(GLuint textureId);
-void URender(vector<GLMesh>& scene);
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint &programId);
-void UDestroyShaderProgram(GLuint programId);
+void UCreateWrapSamplers();
+GLuint UWrapSampler(GLint wrapMode);
+void URender(const MeshStore& scene);
+void UConfigureProgram(ShaderProgram& program);
 
 
-/* Cube Vertex Shader Source Code*/
-const GLchar * keyVertexShaderSource = GLSL(440,
-
-    layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
-    layout (location = 1) in vec3 normal; // VAP position 1 for normals
-    layout (location = 2) in vec2 textureCoordinate;
-
-    out vec3 vertexNormal; // For outgoing normals to fragment shader
-    out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
-    out vec2 vertexTextureCoordinate;
-
-    //Uniform / Global variables for the  transform matrices
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+int main(int argc, char* argv[])
+{
+    UParseOptions(argc, argv);
 
-    void main()
+    // shape generation needs no window
+    if (gMeshBenchmarkSides > 0)
     {
-        gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
-
-        vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
-
-        vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
-        vertexTextureCoordinate = textureCoordinate;
+        UBenchmarkMeshes(gMeshBenchmarkSides);
+        return EXIT_SUCCESS;
     }
-);
-
-
-/* Cube Fragment Shader Source Code*/
-const GLchar * keyFragmentShaderSource = GLSL(440,
-
-    in vec3 vertexNormal; // For incoming normals
-    in vec3 vertexFragmentPos; // For incoming fragment position
-    in vec2 vertexTextureCoordinate;
-
-    out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-    // Uniform / Global variables for object color, light color, light position, and camera/view position
-    uniform vec3 objectColor;
-    uniform vec3 lightColor;
-    uniform vec3 lightPos;
-    uniform vec3 viewPosition;
-    uniform sampler2D uTexture; // Useful when working with multiple textures
-    uniform vec2 uvScale;
-
-    void main()
+    // so is checking the vertex formats, on the CPU copy of the scene's geometry
+    if (gVerifyVertexFormats)
     {
-        /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
-
-        //Calculate Ambient lighting*/
-        float ambientStrength = 0.4f; // Set ambient or global lighting strength
-        vec3 ambient = ambientStrength * lightColor; // Generate ambient light color
-
-        //Calculate Diffuse lighting*/
-        vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-        vec3 lightDirection = normalize(lightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-        float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-        vec3 diffuse = impact * lightColor; // Generate diffuse light color
-
-        //Calculate Specular lighting*/
-        float specularIntensity = 0.8f; // Set specular light strength
-        float highlightSize = 16.0f; // Set specular highlight size
-        vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-        vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-        //Calculate specular component
-        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-        vec3 specular = specularIntensity * specularComponent * lightColor;
-
-        // Texture holds the color to be used for all three components
-        vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
-
-        // Calculate phong result
-        vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
-
-        fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+        gWorkers.Create();
+        UCreateScene(scene, gInstanceBatches);
+        UCreatePenField(gInstanceBatches, gPenInstances);
+        UCreateGizmos(gGizmos);
+        const bool inBounds = ShapeCreator::UGeometry().VerifyFormats(cout);
+        gWorkers.Destroy();
+        return inBounds ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-);
-
-
-/* Lamp Shader Source Code*/
-const GLchar * spotVertexShaderSource = GLSL(440,
 
-    layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
+    if (!UInitialize(argc, argv, &gWindow))
+        return EXIT_FAILURE;
 
-        //Uniform / Global variables for the  transform matrices
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    // from here on every state change goes through the cache, starting from what the context has
+    UStateCache().Sync();
 
-    void main()
+    // the scene shader reads its per-draw data with gl_BaseInstance
+    if (!GLEW_ARB_shader_draw_parameters)
     {
-        gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+        cout << "ERROR: GL_ARB_shader_draw_parameters is required" << endl;
+        return EXIT_FAILURE;
     }
-);
-
 
-/* Fragment Shader Source Code*/
-const GLchar * spotFragmentShaderSource = GLSL(440,
+    // shapes are built and textures decoded on the workers
+    gWorkers.Create();
 
-    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
+    // Create the scene
+    UCreateScene(scene, gInstanceBatches);
+    UCreatePenField(gInstanceBatches, gPenInstances);
+    UCreateGizmos(gGizmos);
+    MeshIndexer::UReportStats(cout);
+
+    // upload all static geometry into the shared buffers at once, packed into the chosen format
+    ShapeCreator::UGeometry().SetFormat(gVertexFormat);
+    const bool vertexErrorInBounds = ShapeCreator::UGeometry().Commit();
+    ShapeCreator::UGeometry().ReportFormat(cout);
+    if (!vertexErrorInBounds)
+        cout << "WARNING: packed vertices exceed the error bound of their format, see --verify-vertex-formats" << endl;
+    gSceneDraws.Create();
+
+    // Create the shader programs, from the binaries of the last launch where the driver takes them
+    if (gUseProgramCache && !gProgramCache.Open(gProgramCachePath))
+        cout << "INFO: the driver offers no program binary format, programs are compiled every launch" << endl;
+    const auto programsStart = chrono::steady_clock::now();
+
+    gShaders.Create(&gProgramCache);
+    gShaders.Add(gKeyLightProgram, "shaders/key.vert", "shaders/key.frag");
+    gShaders.Add(gSpotLightProgram, "shaders/spot.vert", "shaders/spot.frag");
+    gShaders.Add(gInstancedProgram, "shaders/instanced.vert", "shaders/key.frag");
+    gShaders.Add(gShadowProgram, "shaders/key.vert", "shaders/depth.frag");
+    gShaders.Add(gShadowInstancedProgram, "shaders/instanced.vert", "shaders/depth.frag");
+    gShaders.Add(gShadowLampProgram, "shaders/spot.vert", "shaders/depth.frag");
+    gShaders.SetOnLinked(UConfigureProgram);
+    gShaders.SetHotReload(gShaderReload);
+    if (!gShaders.Build())
+        return EXIT_FAILURE;
 
-    void main()
-    {
-        fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
-    }
-);
+    gProgramCache.CountCompile(chrono::duration<double, milli>(chrono::steady_clock::now() - programsStart).count());
+    gProgramCache.Report(cout);
+    gShaders.Report(cout);
+    if (!gProgramCache.Save())
+        cout << "WARNING: could not write the program cache " << gProgramCachePath << endl;
 
+    gFrameUniforms.Create();
+    gLightClusters.Create();
+    UCreateWrapSamplers();
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char *image, int width, int height, int channels)
-{
-    for (int j = 0; j < height / 2; ++j)
+    // frame uniforms, culled commands and visible instances all go through one ring
+    if (gUploadRing.Create(gUploadRingKiB * 1024))
     {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
+        gFrameUniforms.SetUploadRing(&gUploadRing);
+        gLightClusters.SetUploadRing(&gUploadRing);
+        gSceneDraws.SetUploadRing(&gUploadRing);
+        for (auto& batch : gInstanceBatches)
+            batch.SetUploadRing(&gUploadRing);
     }
-}
-
-
-int main(int argc, char* argv[])
-{
-    if (!UInitialize(argc, argv, &gWindow))
-        return EXIT_FAILURE;
-
-    // Create the scene
-    UCreateScene(scene);
-
-    // Create the shader programs
-    if (!UCreateShaderProgram(keyVertexShaderSource, keyFragmentShaderSource, gKeyLightId))
-        return EXIT_FAILURE;
+    else
+        cout << "WARNING: could not map the upload ring, dynamic data falls back to glBufferSubData" << endl;
+    gProfiler.Create();
 
-    if (!UCreateShaderProgram(spotVertexShaderSource, spotFragmentShaderSource, gSpotLightId))
-        return EXIT_FAILURE;
+    // textures start as placeholders and are filled in as the workers decode them
+    gTextures.SetWorkers(&gWorkers);
+    gTextures.SetBakedTextures(gBakedTextures);
 
     for (auto& m : scene)
     {
@@ -245,52 +380,188 @@ int main(int argc, char* argv[])
         }
     }
 
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gKeyLightId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gKeyLightId, "uTexture"), 0);
+    for (auto& batch : gInstanceBatches)
+    {
+        GLuint textureId;
+        if (!UCreateTexture(batch.Base().texFilename, textureId))
+        {
+            cout << "Failed to load texture " << batch.Base().texFilename << endl;
+            return EXIT_FAILURE;
+        }
+        batch.SetTexture(textureId);
+    }
+
+    // hand the built meshes over to the store; the draw loop only reads its packed arrays
+    for (auto& m : scene)
+        gScene.Register(m);
+    scene.clear();
+    UBuildTextureArrays();
+    UBuildSceneBVH();
+    UCreatePointLights(gPointLights, gPointLightCount);
+    UCreateShadowMap();
+
+    // startup timing, from window creation until the first frame and until every texture is in
+    bool firstFrame = true;
+    bool texturesLoaded = false;
+    double lastOverlay = 0.0;
+
+    // a benchmark measures the finished scene, not the streaming
+    if (gHeadlessFrames > 0)
+    {
+        gWorkers.Wait();
+        if (gTextures.Update() > 0)
+            UBuildTextureArrays();
+    }
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(gWindow))
+    int frame = 0;
+    size_t soakGLObjects = 0;
+    size_t soakOwnedObjects = 0;
+    while (gHeadlessFrames > 0 ? frame < gHeadlessFrames : !glfwWindowShouldClose(gWindow))
     {
         // per-frame timing
         // --------------------
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
+        gProfiler.BeginFrame();
+        double currentFrame = UGetTime();
+        gDeltaTime = (float)(currentFrame - gLastFrame);
         gLastFrame = currentFrame;
 
         // input
         // -----
-        UProcessInput(gWindow);
+        gProfiler.Begin(PROFILE_INPUT);
+        if (gWindow)
+            UProcessInput(gWindow);
+        else
+            UFollowBenchmarkPath(frame);
+        gProfiler.End(PROFILE_INPUT);
+
+        // swap finished textures in for their placeholders
+        gProfiler.Begin(PROFILE_UPDATE);
+        if (gTextures.Update() > 0)
+            UBuildTextureArrays();
+        // and rebuilt shader programs for the ones they replace
+        gShaders.Update(currentFrame);
+        gProfiler.End(PROFILE_UPDATE);
 
         // Render this frame
-        URender(scene);
+        URender(gScene);
 
-        glfwPollEvents();
-    }
+        if (firstFrame)
+        {
+            cout << "INFO: First frame after " << UGetTime() * 1000.0 << " ms ("
+                 << gTextures.Pending() << " textures still decoding on " << gWorkers.Threads() << " threads)" << endl;
+            firstFrame = false;
+        }
+        if (!texturesLoaded && gTextures.Pending() == 0)
+        {
+            cout << "INFO: All textures loaded after " << UGetTime() * 1000.0 << " ms" << endl;
+            texturesLoaded = true;
+            gTextures.ReportStats(cout);
+        }
 
-    //clean up
-    for (auto& m : scene) {
-        UDestroyMesh(m);
+        gProfiler.Begin(PROFILE_INPUT);
+        if (gWindow)
+            glfwPollEvents();
+        gProfiler.End(PROFILE_INPUT);
+
+        gProfiler.EndFrame();
+        UStateCache().EndFrame();
+        ++frame;
+
+        // everything created on first use exists after one frame
+        if (gSoak && frame == 1)
+        {
+            soakGLObjects = UCountGLObjects();
+            soakOwnedObjects = UCountOwnedObjects();
+        }
+
+        if (gWindow && gProfileOverlay && currentFrame - lastOverlay > 1.0)
+        {
+            const string drawn = " | " + to_string(gSceneDraws.Visible()) + "/" + to_string(gSceneDraws.Size()) + " drawn"
+                + (gLodFrames > 0 ? " | " + to_string(gFrameTriangles) + " tris" : "");
+            glfwSetWindowTitle(gWindow, (string(WINDOW_TITLE) + " - " + gProfiler.Overlay() + drawn).c_str());
+            lastOverlay = currentFrame;
+        }
     }
 
-    scene.clear();
+    gProfiler.Report(cout);
+    bool leaked = false;
+    if (gSoak)
+    {
+        const size_t glObjects = UCountGLObjects();
+        const size_t ownedObjects = UCountOwnedObjects();
+        leaked = glObjects > soakGLObjects || ownedObjects > soakOwnedObjects;
+        cout << (leaked ? "ERROR" : "INFO") << ": Soak over " << frame << " frames: " << soakGLObjects << " -> " << glObjects
+             << " GL buffers, vertex arrays and textures, " << soakOwnedObjects << " -> " << ownedObjects
+             << " geometry pool objects, meshes, gizmos and textures" << endl;
+    }
+    gUploadRing.Report(cout);
+    gLightClusters.Report(cout);
+    gShadowMap.Report(cout);
+    UStateCache().Report(cout);
+    if (gCullTested > 0)
+        cout << "INFO: Frustum culling kept " << gCullVisible << " of " << gCullTested << " draws ("
+             << 100.0 * gCullVisible / gCullTested << "%)" << endl;
+    if (gLodFrames > 0)
+        cout << "INFO: LOD: " << gTrianglesDrawn / gLodFrames << " triangles per frame on average, "
+             << gLods.Switches() << " level switches, " << gLods.OverBudgetFrames() << " frames over the budget" << endl;
+    if (gQueueFrames > 0)
+        cout << "INFO: Render queue: " << (double)gQueuedDraws / gQueueFrames << " draws per frame sorted in "
+             << gQueueMilliseconds / gQueueFrames << " ms, state changes per frame " << (double)gStateChangesUnsorted / gQueueFrames
+             << " in scene order, " << (double)gStateChangesSorted / gQueueFrames << " sorted"
+             << (gDepthPrepass ? ", with a depth prepass" : "") << endl;
+    if (!gProfileCsv.empty() && !gProfiler.WriteCsv(gProfileCsv))
+        cout << "Failed to write " << gProfileCsv << endl;
+
+    // programs rebuilt during the run start warm next time
+    gShaders.Report(cout);
+    if (!gProgramCache.Save())
+        cout << "WARNING: could not write the program cache " << gProgramCachePath << endl;
 
-    // Release texture
-    UDestroyTexture(gTextureId);
+    //clean up
+    gWorkers.Destroy();
+    for (MeshStore::Handle h = 0; h < gScene.Size(); ++h)
+        UDestroyTexture(gScene.Hot().textureId[h]);
+    for (auto& batch : gInstanceBatches)
+        UDestroyTexture(batch.Texture());
+    gScene.Clear();
+    gGizmos.Clear();
+    gSceneDraws.Destroy();
+    gLightClusters.Destroy();
+    gShadowMap.Destroy();
+    for (auto& batch : gInstanceBatches)
+        batch.Destroy();
+    gInstanceBatches.clear();
+    ShapeCreator::UGeometry().Destroy();
+    gTextureArrays.Destroy();
+    gTextures.Clear();
 
     // Release shader program
-    UDestroyShaderProgram(gKeyLightId);
-    UDestroyShaderProgram(gSpotLightId);
-
-    exit(EXIT_SUCCESS); // Terminates the program successfully
+    gShaders.Destroy();
+    glDeleteSamplers(4, gWrapSamplers);
+    gFrameUniforms.Destroy();
+    gUploadRing.Destroy();
+    gProfiler.Destroy();
+    gHeadless.Destroy();
+
+    exit(leaked ? EXIT_FAILURE : EXIT_SUCCESS); // Terminates the program successfully
 }
 
 
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
+    // no window at all: an offscreen context that also initializes GLEW
+    if (gHeadlessFrames > 0)
+    {
+        if (!gHeadless.Create(WINDOW_WIDTH, WINDOW_HEIGHT))
+            return false;
+
+        cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << " (headless, " << glGetString(GL_RENDERER) << ")" << endl;
+        return true;
+    }
+
     // GLFW: initialize and configure
     // ------------------------------
     glfwInit();
@@ -339,6 +610,135 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 }
 
 
+// Reads the command line options
+void UParseOptions(int argc, char* argv[])
+{
+    for (int i = 1; i < argc - 1; ++i)
+    {
+        if (string(argv[i]) == "--pens")
+            gPenInstances = atoi(argv[i + 1]);
+        if (string(argv[i]) == "--texture-binding")
+            gUseTextureArrays = string(argv[i + 1]) != "batch";
+        if (string(argv[i]) == "--profile-csv")
+            gProfileCsv = argv[i + 1];
+        if (string(argv[i]) == "--headless")
+            gHeadlessFrames = atoi(argv[i + 1]);
+        if (string(argv[i]) == "--soak")
+        {
+            gHeadlessFrames = atoi(argv[i + 1]);
+            gSoak = true;
+        }
+        if (string(argv[i]) == "--mesh-benchmark")
+            gMeshBenchmarkSides = atoi(argv[i + 1]);
+        if (string(argv[i]) == "--lod-error")
+            gLodError = (float)atof(argv[i + 1]);
+        if (string(argv[i]) == "--triangle-budget")
+            gTriangleBudget = strtoull(argv[i + 1], nullptr, 10);
+        if (string(argv[i]) == "--shadow-size")
+            gShadowResolution = atoi(argv[i + 1]);
+        if (string(argv[i]) == "--shadow-pcf")
+            gShadowPcf = atoi(argv[i + 1]);
+        if (string(argv[i]) == "--shadow-policy" && !UParseShadowPolicy(argv[i + 1], gShadowPolicy))
+            cout << "WARNING: unknown shadow policy " << argv[i + 1] << ", using cached" << endl;
+        if (string(argv[i]) == "--lights")
+            gPointLightCount = atoi(argv[i + 1]);
+        if (string(argv[i]) == "--program-cache")
+            gProgramCachePath = argv[i + 1];
+        if (string(argv[i]) == "--upload-ring-kib")
+            gUploadRingKiB = strtoull(argv[i + 1], nullptr, 10);
+        if (string(argv[i]) == "--vertex-format" && !UParseVertexFormat(argv[i + 1], gVertexFormat))
+            cout << "WARNING: unknown vertex format " << argv[i + 1] << ", using " << UVertexFormat(gVertexFormat).name << endl;
+    }
+    for (int i = 1; i < argc; ++i)
+    {
+        if (string(argv[i]) == "--overlay")
+            gProfileOverlay = true;
+        if (string(argv[i]) == "--no-culling")
+            gFrustumCulling = false;
+        if (string(argv[i]) == "--no-bvh")
+            gUseBVH = false;
+        if (string(argv[i]) == "--no-lod")
+            gUseLod = false;
+        if (string(argv[i]) == "--no-program-cache")
+            gUseProgramCache = false;
+        if (string(argv[i]) == "--no-baked-textures")
+            gBakedTextures = false;
+        if (string(argv[i]) == "--no-shader-reload")
+            gShaderReload = false;
+        if (string(argv[i]) == "--no-sort")
+            gSortDraws = false;
+        if (string(argv[i]) == "--depth-prepass")
+            gDepthPrepass = true;
+        if (string(argv[i]) == "--verify-vertex-formats")
+            gVerifyVertexFormats = true;
+    }
+}
+
+
+// Seconds since startup, from GLFW or from the headless context
+double UGetTime()
+{
+    return gWindow ? glfwGetTime() : gHeadless.Time();
+}
+
+
+// Buffers, vertex arrays and textures alive in the context, whoever created them
+size_t UCountGLObjects()
+{
+    GLuint probe[3];
+    glGenBuffers(1, &probe[0]);
+    glGenVertexArrays(1, &probe[1]);
+    glGenTextures(1, &probe[2]);
+
+    // a fresh name need not be the highest one, so the scan goes on until a long run of unused ones
+    auto countLive = [](GLuint probeName, auto isObject) {
+        size_t live = 0;
+        for (GLuint name = 1, lastLive = 0; name < probeName || name - lastLive <= 1024; ++name)
+        {
+            if (isObject(name) == GL_TRUE)
+            {
+                ++live;
+                lastLive = name;
+            }
+        }
+        return live;
+    };
+    const size_t live = countLive(probe[0], [](GLuint name) { return glIsBuffer(name); })
+        + countLive(probe[1], [](GLuint name) { return glIsVertexArray(name); })
+        + countLive(probe[2], [](GLuint name) { return glIsTexture(name); });
+
+    glDeleteBuffers(1, &probe[0]);
+    glDeleteVertexArrays(1, &probe[1]);
+    UStateCache().DeleteTextures(1, &probe[2]);
+    return live;
+}
+
+
+// What the renderer's own containers hold
+size_t UCountOwnedObjects()
+{
+    return ShapeCreator::UGeometry().LiveGLObjects() + gScene.Size() + gGizmos.Size() + gTextures.UniqueTextures();
+}
+
+
+// Headless camera: one slow orbit around the desk per 600 frames at a fixed time step,
+// so every run renders exactly the same frames
+void UFollowBenchmarkPath(int frame)
+{
+    gDeltaTime = 1.0f / 60.0f;
+
+    const float angle = glm::radians(90.0f + 360.0f * (frame % 600) / 600.0f);
+    const glm::vec3 target(0.0f, 0.0f, 0.0f);
+    gCamera.Position = glm::vec3(50.0f * cos(angle), 10.0f, 50.0f * sin(angle));
+
+    // point the camera at the target, then let it rebuild its vectors
+    const glm::vec3 direction = glm::normalize(target - gCamera.Position);
+    gCamera.Yaw = glm::degrees(atan2(direction.z, direction.x));
+    gCamera.Pitch = glm::degrees(asin(direction.y));
+    gCamera.ProcessMouseMovement(0.0f, 0.0f);
+}
+
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void UProcessInput(GLFWwindow* window)
 {
@@ -362,49 +762,27 @@ void UProcessInput(GLFWwindow* window)
         perspective = (perspective ? false : true); // changes view type
     }
 
+    // the sampler of the new wrap mode is bound from the next frame on
     if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS && gTexWrapMode != GL_REPEAT)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
         gTexWrapMode = GL_REPEAT;
 
         cout << "Current Texture Wrapping Mode: REPEAT" << endl;
     }
     else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS && gTexWrapMode != GL_MIRRORED_REPEAT)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
         gTexWrapMode = GL_MIRRORED_REPEAT;
 
         cout << "Current Texture Wrapping Mode: MIRRORED REPEAT" << endl;
     }
     else if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_EDGE)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
         gTexWrapMode = GL_CLAMP_TO_EDGE;
 
         cout << "Current Texture Wrapping Mode: CLAMP TO EDGE" << endl;
     }
     else if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_BORDER)
     {
-        float color[] = {1.0f, 0.0f, 1.0f, 1.0f};
-        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, color);
-
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
         gTexWrapMode = GL_CLAMP_TO_BORDER;
 
         cout << "Current Texture Wrapping Mode: CLAMP TO BORDER" << endl;
@@ -433,7 +811,7 @@ void UProcessInput(GLFWwindow* window)
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    UStateCache().Viewport(0, 0, width, height);
 }
 
 
@@ -474,7 +852,10 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
         case GLFW_MOUSE_BUTTON_LEFT:
         {
             if (action == GLFW_PRESS)
+            {
                 cout << "Left mouse button pressed" << endl;
+                UPickObject(window);
+            }
             else
                 cout << "Left mouse button released" << endl;
         }
@@ -505,7 +886,10 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 }
 
 // creates each mesh using ShapeCreator class
-void UCreateScene(vector<GLMesh>& scene) {
+void UCreateScene(vector<GLMesh>& scene, vector<InstanceBatch>& batches) {
+    // every shape is described first and then built at once on the workers
+    vector<pair<GLMesh*, ShapeCreator::Builder>> jobs;
+
     // Folder plane
     GLMesh gPlane;
     gPlane.p = {
@@ -517,9 +901,8 @@ void UCreateScene(vector<GLMesh>& scene) {
         0.0f, 0.0f, 0.0f,					// translate x, y, z
         1.0f, 1.0f                          // texture scale
     };
-    gPlane.texFilename = "textures\\FolderTexture.png";
-    ShapeCreator::UBuildPlane(gPlane);
-    scene.push_back(gPlane);
+    gPlane.texFilename = "textures/FolderTexture.png";
+    jobs.push_back({ &gPlane, ShapeCreator::UBuildPlane });
   
     //SSD body
     GLMesh gSSDBody;
@@ -532,43 +915,24 @@ void UCreateScene(vector<GLMesh>& scene) {
         -10.0f, 0.0f, -10.0f,				// translate x, y, z
         1.0f, 1.0f                          // texture scale
     };
-    gSSDBody.texFilename = "textures\\SSDtexture.jpg";
-    ShapeCreator::UBuildCube(gSSDBody);
-    scene.push_back(gSSDBody);
+    gSSDBody.texFilename = "textures/SSDtexture.jpg";
+    jobs.push_back({ &gSSDBody, ShapeCreator::UBuildCube });
 
-    //SSD edge 1
-    GLMesh gSSDEdge1;
-    gSSDEdge1.p = {
+    //SSD edges: one cylinder drawn twice
+    GLMesh gSSDEdge;
+    gSSDEdge.p = {
         1.0f, 1.0f, 1.0f, 1.0f,				// color r, g, b a
         1.0f, 1.0f, 1.0f,					// scale x, y, z
         0.0f, 1.0f, 0.0f, 0.0f,				// x amount of rotation, rotate x, y, z
         90.0f, 0.0f, 1.0f, 0.0f,			// y amount of rotation, rotate x, y, z
         0.0f, 0.0f, 0.0f, 1.0f,				// z amount of rotation, rotate x, y, z
-        -13.75f, 0.0f, -11.75f,				// translate x, y, z
+        0.0f, 0.0f, 0.0f,					// translate x, y, z (per instance)
         1.0f, 1.0f
     };
 
-    gSSDEdge1.length = 7.5f;	gSSDEdge1.radius = 0.5f;	gSSDEdge1.number_of_sides = 30.0f;
-    gSSDEdge1.texFilename = "textures\\SSDtexture.jpg";
-    ShapeCreator::UBuildCylinder(gSSDEdge1);
-    scene.push_back(gSSDEdge1);
-
-    //SSD edge 2
-    GLMesh gSSDEdge2;
-    gSSDEdge2.p = {
-        1.0f, 1.0f, 1.0f, 1.0f,				// color r, g, b a
-        1.0f, 1.0f, 1.0f,					// scale x, y, z
-        0.0f, 1.0f, 0.0f, 0.0f,				// x amount of rotation, rotate x, y, z
-        90.0f, 0.0f, 1.0f, 0.0f,			// y amount of rotation, rotate x, y, z
-        0.0f, 0.0f, 0.0f, 1.0f,				// z amount of rotation, rotate x, y, z
-        -13.75f, 0.0f, -7.25f,				// translate x, y, z
-        1.0f, 1.0f
-    };
-
-    gSSDEdge2.length = 7.5f;	gSSDEdge2.radius = 0.5f;	gSSDEdge2.number_of_sides = 30.0f;
-    gSSDEdge2.texFilename = "textures\\SSDtexture.jpg";
-    ShapeCreator::UBuildCylinder(gSSDEdge2);
-    scene.push_back(gSSDEdge2);
+    gSSDEdge.length = 7.5f;	gSSDEdge.radius = 0.5f;	gSSDEdge.number_of_sides = 30.0f;
+    gSSDEdge.texFilename = "textures/SSDtexture.jpg";
+    jobs.push_back({ &gSSDEdge, ShapeCreator::UBuildCylinder });
 
     //Tape measure body
     GLMesh gTapeMeasureBody;
@@ -581,9 +945,8 @@ void UCreateScene(vector<GLMesh>& scene) {
         10.0f, 0.0f, -10.0f,			    // translate x, y, z
         1.0f, 1.0f                          // texture scale
     };
-    gTapeMeasureBody.texFilename = "textures\\blue.jpg";
-    ShapeCreator::UBuildCube(gTapeMeasureBody);
-    scene.push_back(gTapeMeasureBody);
+    gTapeMeasureBody.texFilename = "textures/blue.jpg";
+    jobs.push_back({ &gTapeMeasureBody, ShapeCreator::UBuildCube });
     
     //Tape measure button
     GLMesh gTapeMeasureButton;
@@ -597,9 +960,8 @@ void UCreateScene(vector<GLMesh>& scene) {
         1.0f, 1.0f
     };
     gTapeMeasureButton.length = 1.4f;	gTapeMeasureButton.radius = 0.5f;	gTapeMeasureButton.number_of_sides = 30.0f;
-    gTapeMeasureButton.texFilename = "textures\\white.png";
-    ShapeCreator::UBuildCylinder(gTapeMeasureButton);
-    scene.push_back(gTapeMeasureButton);
+    gTapeMeasureButton.texFilename = "textures/white.png";
+    jobs.push_back({ &gTapeMeasureButton, ShapeCreator::UBuildCylinder });
 
     //Tape roll
     GLMesh gTapeRoll;
@@ -613,9 +975,8 @@ void UCreateScene(vector<GLMesh>& scene) {
         1.0f, 1.0f
     };
     gTapeRoll.length = 2.0f;	gTapeRoll.radius = 2.75f;	gTapeRoll.number_of_sides = 30.0f;
-    gTapeRoll.texFilename = "textures\\white.png";
-    ShapeCreator::UBuildCylinder(gTapeRoll);
-    scene.push_back(gTapeRoll);
+    gTapeRoll.texFilename = "textures/white.png";
+    jobs.push_back({ &gTapeRoll, ShapeCreator::UBuildCylinder });
 
     //Tape holder
     GLMesh gTapeHolder;
@@ -629,9 +990,8 @@ void UCreateScene(vector<GLMesh>& scene) {
         1.0f, 1.0f
     };
     gTapeHolder.length = 2.5f;	gTapeHolder.radius = 1.25f;	gTapeHolder.number_of_sides = 30.0f;
-    gTapeHolder.texFilename = "textures\\blackTex.jpg";
-    ShapeCreator::UBuildCylinder(gTapeHolder);
-    scene.push_back(gTapeHolder);
+    gTapeHolder.texFilename = "textures/blackTex.jpg";
+    jobs.push_back({ &gTapeHolder, ShapeCreator::UBuildCylinder });
 
     //Tape holder tab
     GLMesh gTapeHolderTab;
@@ -645,9 +1005,8 @@ void UCreateScene(vector<GLMesh>& scene) {
         1.0f, 1.0f
     };
     gTapeHolderTab.length = 3.0f;	gTapeHolderTab.radius = 0.25f;	gTapeHolderTab.number_of_sides = 30.0f;
-    gTapeHolderTab.texFilename = "textures\\blackTex.jpg";
-    ShapeCreator::UBuildCylinder(gTapeHolderTab);
-    scene.push_back(gTapeHolderTab);
+    gTapeHolderTab.texFilename = "textures/blackTex.jpg";
+    jobs.push_back({ &gTapeHolderTab, ShapeCreator::UBuildCylinder });
 
     //Pen body
     GLMesh gPenBody;
@@ -661,9 +1020,8 @@ void UCreateScene(vector<GLMesh>& scene) {
         1.0f, 1.0f
     };
     gPenBody.length = 13.0f;	gPenBody.radius = 0.4f;	gPenBody.number_of_sides = 30.0f;
-    gPenBody.texFilename = "textures\\blackTex.jpg";
-    ShapeCreator::UBuildCylinder(gPenBody);
-    scene.push_back(gPenBody);
+    gPenBody.texFilename = "textures/blackTex.jpg";
+    jobs.push_back({ &gPenBody, ShapeCreator::UBuildCylinder });
 
     //Pen cap
     GLMesh gPenCap;
@@ -677,26 +1035,108 @@ void UCreateScene(vector<GLMesh>& scene) {
         1.0f, 1.0f
     };
     gPenCap.length = 5.5f;	gPenCap.radius = 0.5f;	gPenCap.number_of_sides = 30.0f;
-    gPenCap.texFilename = "textures\\blackTex.jpg";
-    ShapeCreator::UBuildCylinder(gPenCap);
-    scene.push_back(gPenCap);
+    gPenCap.texFilename = "textures/blackTex.jpg";
+    jobs.push_back({ &gPenCap, ShapeCreator::UBuildCylinder });
+
+    ShapeCreator::UBuildParallel(jobs, gWorkers);
+
+    for (GLMesh* mesh : { &gPlane, &gSSDBody, &gTapeMeasureBody, &gTapeMeasureButton, &gTapeRoll, &gTapeHolder, &gTapeHolderTab, &gPenBody, &gPenCap })
+        scene.push_back(*mesh);
+
+    InstanceBatch gSSDEdges;
+    gSSDEdges.Create(gSSDEdge);
+    gSSDEdges.Add(glm::translate(glm::vec3(-13.75f, 0.0f, -11.75f)));		// SSD edge 1
+    gSSDEdges.Add(glm::translate(glm::vec3(-13.75f, 0.0f, -7.25f)));		// SSD edge 2
+    batches.push_back(gSSDEdges);
 }
 
 
-// Functioned called to render a frame
-void URender(vector<GLMesh>& scene)
+// lays out count copies of the pen body on a square grid, all drawn with one instanced call
+void UCreatePenField(vector<InstanceBatch>& batches, int count)
 {
-    // Lamp orbits around the origin
-    const float angularVelocity = glm::radians(45.0f);
-    if (gSpotLightOrbit)
+    if (count <= 0)
+        return;
+
+    GLMesh gPen;
+    gPen.p = {
+        1.0f, 1.0f, 1.0f, 1.0f,
+        1.0f, 1.0f, 1.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        -75.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f,
+        0.0f, 0.01f, 0.0f,
+        1.0f, 1.0f
+    };
+    gPen.length = 13.0f;	gPen.radius = 0.4f;	gPen.number_of_sides = 30.0f;
+    gPen.texFilename = "textures/blackTex.jpg";
+    ShapeCreator::UBuildCylinder(gPen);
+
+    InstanceBatch pens;
+    pens.Create(gPen);
+
+    // the pen lies mostly along x, so rows are long in x and tight in z
+    const int side = (int)ceil(sqrt((double)count));
+    for (int i = 0; i < count; ++i)
     {
-        glm::vec4 newPosition = glm::rotate(angularVelocity * gDeltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gSpotLightPosition, 1.0f);
-        gSpotLightPosition.x = newPosition.x;
-        gSpotLightPosition.y = newPosition.y;
-        gSpotLightPosition.z = newPosition.z;
+        const float x = (i % side - side / 2) * 14.0f;
+        const float z = (i / side - side / 2) * 1.5f;
+        pens.Add(glm::translate(glm::vec3(x, 0.0f, z)));
     }
+    batches.push_back(pens);
+
+    cout << "INFO: " << count << " instanced pens" << endl;
+}
+
+
+// generates large cylinders one after another and then on the workers, and prints the vertex rate
+void UBenchmarkMeshes(int sides)
+{
+    gWorkers.Create();
+    const size_t count = max<size_t>(4, 2 * gWorkers.Threads());
+
+    GLMesh cylinder;
+    cylinder.p = {
+        1.0f, 1.0f, 1.0f, 1.0f,
+        1.0f, 1.0f, 1.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 0.0f,
+        1.0f, 1.0f
+    };
+    cylinder.length = 1.0f;	cylinder.radius = 0.5f;	cylinder.number_of_sides = (float)sides;
+    vector<GLMesh> meshes(count, cylinder);
+
+    // twelve soup vertices per side
+    const double vertices = 12.0 * sides * count;
+    auto report = [vertices](const char* what, chrono::steady_clock::time_point start) {
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "  " << what << (vertices / seconds) / 1e6 << " M vertices/s (" << seconds * 1000.0 << " ms)" << endl;
+    };
 
-    gSpotLightMesh.p = {
+    cout << "INFO: Generating " << count << " cylinders with " << sides << " sides ("
+         << vertices / 1e6 << " M vertices) on " << gWorkers.Threads() << " workers" << endl;
+
+    auto start = chrono::steady_clock::now();
+    for (auto& mesh : meshes)
+        ShapeCreator::UCylinderVertices(mesh, mesh.number_of_sides);
+    report("serial   ", start);
+
+    start = chrono::steady_clock::now();
+    for (auto& mesh : meshes)
+        gWorkers.Submit([&mesh]() { ShapeCreator::UCylinderVertices(mesh, mesh.number_of_sides); });
+    gWorkers.Wait();
+    report("parallel ", start);
+
+    gWorkers.Destroy();
+}
+
+
+// builds the light gizmos once; URender only updates their transforms
+void UCreateGizmos(MeshStore& gizmos)
+{
+    GLMesh spotLightMesh;
+    spotLightMesh.p = {
     0.0f, 1.0f, 0.0f, 1.0f,				// color r, g, b a
     5.0f, 1.0f, 5.0f,					// scale x, y, z
     0.0f, 1.0f, 0.0f, 0.0f,				// x amount of rotation, rotate x, y, z
@@ -705,10 +1145,38 @@ void URender(vector<GLMesh>& scene)
     0.0f, 0.0f, 0.0f,					// translate x, y, z
     1.0f, 1.0f                          // texture scale
     };
-    ShapeCreator::UBuildPlane(gSpotLightMesh);
+    ShapeCreator::UBuildPlane(spotLightMesh);
+    gSpotLightGizmo = gizmos.Register(spotLightMesh);
+    gizmos.SetTransform(gSpotLightGizmo, glm::translate(gSpotLightPosition) * glm::scale(gSpotLightScale));
+}
+
+
+// Functioned called to render a frame
+void URender(const MeshStore& scene)
+{
+    gProfiler.Begin(PROFILE_UPDATE);
+
+    // Lamp orbits around the origin
+    const float angularVelocity = glm::radians(45.0f);
+    if (gSpotLightOrbit)
+    {
+        glm::vec4 newPosition = glm::rotate(angularVelocity * gDeltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gSpotLightPosition, 1.0f);
+        gSpotLightPosition.x = newPosition.x;
+        gSpotLightPosition.y = newPosition.y;
+        gSpotLightPosition.z = newPosition.z;
+
+        // the gizmo geometry is persistent; only its transform follows the light
+        gGizmos.SetTransform(gSpotLightGizmo, glm::translate(gSpotLightPosition) * glm::scale(gSpotLightScale));
+    }
+
+    // everything the GPU does for the frame, up to the swap
+    gProfiler.BeginGpu();
+
+    // the ring space of the oldest frame in flight is reused from here on
+    gUploadRing.BeginFrame();
 
     // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+    UStateCache().Enable(GL_DEPTH_TEST);
     
     // Clear the frame and z buffers
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -717,213 +1185,669 @@ void URender(vector<GLMesh>& scene)
 
     //Draw scene
 
-    // 1. Scales the object by 2
-    glm::mat4 scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    glm::mat4 rotation = glm::rotate(45.0f, glm::vec3(1.0, 1.0f, 1.0f));
-    // 3. Place object at the origin
-    glm::mat4 translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 model = translation * rotation * scale;
-
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
 
     // Creates a perspective projection
-    glm::mat4 projection;
-    if (perspective) {
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 projection = UProjection();
+
+    // Upload everything that is shared by all draws of this frame once
+    FrameData frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.objectColor = glm::vec4(gKeyLightColor, 1.0f);
+    frame.lightColor = glm::vec4(gSpotLightColor, 1.0f);
+    frame.lightPosition = glm::vec4(gSpotLightPosition, 1.0f);
+    frame.viewPosition = glm::vec4(gCamera.Position, 1.0f);
+    frame.positionOffset = ShapeCreator::UGeometry().Decode().positionOffset;
+    frame.positionScale = ShapeCreator::UGeometry().Decode().positionScale;
+    frame.texCoordDecode = ShapeCreator::UGeometry().Decode().texCoordDecode;
+    frame.lampModel = gGizmos.Hot().model[gSpotLightGizmo];
+
+    // point lights go into the clusters of this view before any fragment needs them
+    gLightClusters.SetProjection(projection, NEAR_PLANE, FAR_PLANE);
+    gLightClusters.Assign(gPointLights, view);
+    frame.clusterScale = gLightClusters.Scale(WINDOW_WIDTH, WINDOW_HEIGHT);
+    frame.clusterSize = gLightClusters.Size();
+
+    // the commands and per-draw data only change when a mesh does
+    if (scene.Version() != gSceneDrawsVersion)
+    {
+        gSceneDraws.Build(scene.Hot(), gUseTextureArrays ? &gTextureArrays : nullptr);
+        gSceneDrawsVersion = scene.Version();
     }
-    else {
-        projection = glm::ortho(-14.0f, 14.0f, -10.0f, 10.0f, 0.1f, 100.0f);
+
+    // the key light's shadow map, from the cache unless a caster or the light changed
+    UDrawShadows(frame);
+    gFrameUniforms.Update(frame);
+
+    // drop what the camera cannot see before anything is submitted
+    Frustum frustum;
+    frustum.Extract(projection * view);
+    const bool useBVH = gFrustumCulling && gUseBVH;
+
+    // moved meshes and instances only stretch the boxes on their path; the tree itself is kept.
+    // Picking and the levels of detail read them too, so this runs whatever culls
+    URefitMovedObjects();
+
+    // every object that can reach the screen, as SceneBVH objects
+    gVisibleObjects.clear();
+    if (useBVH)
+    {
+        gSceneBVH.Cull(frustum, gVisibleObjects);
+        gCullTested += gSceneBVH.Objects();
+        gCullVisible += gVisibleObjects.size();
+    }
+    else
+    {
+        // the flat tests: a sphere per scene mesh, and a box per batch whose instances go along as a whole
+        const RenderStore& store = scene.Hot();
+        gSceneVisible.assign(store.Size(), 1);
+        if (gFrustumCulling)
+        {
+            gCullTested += store.Size();
+            gCullVisible += frustum.CullSpheres(store.sphereX.data(), store.sphereY.data(), store.sphereZ.data(), store.sphereRadius.data(),
+                store.Size(), gSceneVisible.data());
+        }
+        for (MeshStore::Handle h = 0; h < store.Size(); ++h)
+        {
+            if (gSceneVisible[h])
+                gVisibleObjects.push_back((uint32_t)h);
+        }
+        for (size_t b = 0; b < gInstanceBatches.size(); ++b)
+        {
+            if (gFrustumCulling)
+            {
+                ++gCullTested;
+                if (!frustum.TestBox(gInstanceBatches[b].Bounds()))
+                    continue;
+                ++gCullVisible;
+            }
+            for (size_t i = 0; i < gInstanceBatches[b].Size(); ++i)
+                gVisibleObjects.push_back((uint32_t)(gBatchFirstObject[b] + i));
+        }
     }
-    // Set the shader to be used
-    glUseProgram(gKeyLightId);
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gKeyLightId, "model");
-    GLint viewLoc = glGetUniformLocation(gKeyLightId, "view");
-    GLint projLoc = glGetUniformLocation(gKeyLightId, "projection");
+    // one level per visible object, from its size on screen
+    if (gUseLod)
+    {
+        const float pixelScale = perspective ? WINDOW_HEIGHT / (2.0f * tan(glm::radians(gCamera.Zoom) * 0.5f)) : WINDOW_HEIGHT / 20.0f;
+        gLods.SetView(gCamera.Position, pixelScale, !perspective);
+        gLods.Select(gVisibleObjects, gVisibleLevels);
+        ++gLodFrames;
+    }
+    else
+        gVisibleLevels.assign(gVisibleObjects.size(), 0);
 
-    // loop to draw each shape individually
-    for (auto i = 0; i < scene.size(); ++i)
+    // hand the visible objects back to the scene draws and to their batches
+    gSceneVisible.assign(scene.Size(), 0);
+    gSceneRanges.resize(scene.Size());
+    for (size_t i = 0; i < gInstanceBatches.size(); ++i)
     {
-        auto mesh = scene[i];
+        gBatchVisible[i].clear();
+        gBatchLevels[i].clear();
+    }
+    gFrameTriangles = 0;
+    for (size_t i = 0; i < gVisibleObjects.size(); ++i)
+    {
+        const uint32_t object = gVisibleObjects[i];
+        const LodLevel& level = gLods.Level(object, gVisibleLevels[i]);
+        gFrameTriangles += level.range.indexCount / 3;
+        if (object < scene.Size())
+        {
+            gSceneVisible[object] = 1;
+            gSceneRanges[object] = level.range;
+            continue;
+        }
+        const size_t batch = UBatchOfObject(object);
+        gBatchVisible[batch].push_back((GLuint)(object - gBatchFirstObject[batch]));
+        gBatchLevels[batch].push_back(gVisibleLevels[i]);
+    }
+    if (gUseLod)
+        gTrianglesDrawn += gFrameTriangles;
 
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(mesh.model));
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // the batches that reach the screen
+    gBatchOrder.clear();
+    for (size_t i = 0; i < gInstanceBatches.size(); ++i)
+    {
+        if (!gBatchVisible[i].empty())
+            gBatchOrder.push_back(i);
+    }
 
-        GLint objectColorLoc = glGetUniformLocation(gKeyLightId, "objectColor");
-        GLint lightColorLoc = glGetUniformLocation(gKeyLightId, "lightColor");
-        GLint lightPositionLoc = glGetUniformLocation(gKeyLightId, "lightPos");
-        GLint viewPositionLoc = glGetUniformLocation(gKeyLightId, "viewPosition");
+    // the visible scene draws go to the command list at their level, in queue order when sorting
+    if (gSortDraws)
+    {
+        UQueueDraws(scene.Hot(), view);
+        gSceneDraws.Cull(gSceneOrder, &gSceneRanges);
+    }
+    else
+        gSceneDraws.Cull(gSceneVisible, &gSceneRanges);
 
-        glUniform3f(objectColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-        glUniform3f(lightColorLoc, gSpotLightColor.r, gSpotLightColor.g, gSpotLightColor.b);
-        glUniform3f(lightPositionLoc, gSpotLightPosition.x, gSpotLightPosition.y, gSpotLightPosition.z);
-        const glm::vec3 cameraPosition = gCamera.Position;
-        glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    gProfiler.End(PROFILE_UPDATE);
+    gProfiler.Begin(PROFILE_SUBMIT);
 
-        GLint UVScaleLoc = glGetUniformLocation(gKeyLightId, "uvScale");
-        glUniform2fv(UVScaleLoc, 1, glm::value_ptr(mesh.gUVScale));
+    // with texture arrays every scene draw shares these bindings
+    if (gUseTextureArrays)
+        gTextureArrays.Bind();
 
-        // activate vbo's within mesh's vao
-        glBindVertexArray(mesh.vao);
+    // the wrap mode picked with keys 1-4, for the 2D textures and the arrays alike
+    const GLuint wrapSampler = UWrapSampler(gTexWrapMode);
+    UStateCache().BindSampler(0, wrapSampler);
+    for (GLuint i = 0; i < MAX_TEXTURE_ARRAYS; ++i)
+        UStateCache().BindSampler(TEXTURE_ARRAY_UNIT + i, wrapSampler);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, mesh.textureId);
+    const GeometryPool& geometry = ShapeCreator::UGeometry();
 
-        // Draws the triangles
-        glDrawArrays(GL_TRIANGLES, 0, mesh.nIndices);
+    // depth of every visible surface first, with the depth-only shadow programs; the lit pass
+    // then only passes the depth test on the nearest surface of each pixel
+    if (gDepthPrepass)
+    {
+        UStateCache().ColorMask(GL_FALSE);
+        UStateCache().UseProgram(gShadowProgram.id);
+        gSceneDraws.Submit(geometry);
+        UStateCache().UseProgram(gShadowInstancedProgram.id);
+        UDrawBatches(geometry, gShadowInstancedProgram);
+
+        UStateCache().ColorMask(GL_TRUE);
+        UStateCache().DepthMask(GL_FALSE);
+        UStateCache().DepthFunc(GL_LEQUAL);
     }
 
-    //Draw spotlight
+    // Set the shader to be used
+    UStateCache().UseProgram(gKeyLightProgram.id);
+
+    // the visible part of the scene goes out as one multi-draw per texture (or just one with arrays)
+    gSceneDraws.Submit(geometry, gKeyLightProgram.textureArrayLoc);
+
+    // repeated shapes: one instanced draw per batch
+    UStateCache().UseProgram(gInstancedProgram.id);
+    UDrawBatches(geometry, gInstancedProgram);
+
+    if (gDepthPrepass)
+    {
+        UStateCache().DepthMask(GL_TRUE);
+        UStateCache().DepthFunc(GL_LESS);
+    }
 
-    glUseProgram(gSpotLightId);
+    //Draw spotlight
 
-    //transform lamp
-    model = glm::translate(gSpotLightPosition) * glm::scale(gSpotLightScale);
+    UStateCache().UseProgram(gSpotLightProgram.id);
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gSpotLightId, "model");
-    viewLoc = glGetUniformLocation(gSpotLightId, "view");
-    projLoc = glGetUniformLocation(gSpotLightId, "projection");
+    const RenderStore& gizmos = gGizmos.Hot();
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // its model matrix comes from the frame uniform buffer along with view and projection
 
-    glDrawArrays(GL_TRIANGLES, 0, gSpotLightMesh.nIndices);
+    UStateCache().BindVertexArray(geometry.Vao());
+    glDrawElementsBaseVertex(GL_TRIANGLES, gizmos.indexCount[gSpotLightGizmo], geometry.IndexType(),
+        geometry.IndexOffset(gizmos.firstIndex[gSpotLightGizmo]), gizmos.baseVertex[gSpotLightGizmo]);
 
 
     // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    UStateCache().BindVertexArray(0);
+
+    // the GPU signals when it is done with everything this frame wrote into the ring
+    gUploadRing.EndFrame();
+
+    gProfiler.EndGpu();
+    gProfiler.End(PROFILE_SUBMIT);
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    gProfiler.Begin(PROFILE_SWAP);
+    if (gWindow)
+        glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    else
+        glFinish();    // nothing to present offscreen; wait so the frame time covers the GPU work
+    gProfiler.End(PROFILE_SWAP);
 }
 
 
-void UDestroyMesh(GLMesh &mesh)
+// Projection shared by rendering and picking
+glm::mat4 UProjection()
 {
-    glDeleteVertexArrays(1, &mesh.vao);
-    glDeleteBuffers(1, &mesh.vbo);
+    if (perspective)
+        return glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, NEAR_PLANE, FAR_PLANE);
+    return glm::ortho(-14.0f, 14.0f, -10.0f, 10.0f, NEAR_PLANE, FAR_PLANE);
 }
 
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint &textureId)
+/*World boxes of every scene mesh and batch instance, in SceneBVH object order*/
+vector<BoundingBox> USceneObjectBounds()
 {
-    int width, height, channels;
-    unsigned char *image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
+    vector<BoundingBox> boxes;
+    boxes.reserve(gSceneBVH.Objects());
+    for (MeshStore::Handle h = 0; h < gScene.Size(); ++h)
+        boxes.push_back(gScene.Get(h).worldBox);
+    for (auto& batch : gInstanceBatches)
     {
-        flipImageVertically(image, width, height, channels);
+        for (size_t i = 0; i < batch.Size(); ++i)
+            boxes.push_back(batch.InstanceBounds(i));
+    }
+    return boxes;
+}
 
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
 
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+/*Update the SceneBVH boxes and LOD spheres of the scene meshes and batch instances moved since the last call*/
+void URefitMovedObjects()
+{
+    for (MeshStore::Handle h : gScene.Moved())
+    {
+        const ColdMesh& mesh = gScene.Get(h);
+        gSceneBVH.Refit((uint32_t)h, mesh.worldBox);
+        gLods.SetObject((uint32_t)h, (uint32_t)h, mesh.worldSphere, ULodRadius(mesh.authoring, gScene.Hot().model[h]));
+    }
+    gScene.ClearMoved();
 
-        if (channels == 3)
-        	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-        	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
+    for (size_t b = 0; b < gInstanceBatches.size(); ++b)
+    {
+        InstanceBatch& batch = gInstanceBatches[b];
+        for (size_t i : batch.Moved())
         {
-        	cout << "Not implemented to handle image with " << channels << " channels" << endl;
-        	return false;
+            const uint32_t object = (uint32_t)(gBatchFirstObject[b] + i);
+            gSceneBVH.Refit(object, batch.InstanceBounds(i));
+            gLods.SetObject(object, gBatchLodChain[b], UTransformSphere(batch.Base().localSphere, batch.Model(i)), ULodRadius(batch.Base(), batch.Model(i)));
         }
+        batch.ClearMoved();
+    }
+}
 
-		glGenerateMipmap(GL_TEXTURE_2D);
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+/*Sort the visible scene draws and instance batches by program, texture, vertex array and view depth*/
+void UQueueDraws(const RenderStore& store, const glm::mat4& view)
+{
+    const auto start = chrono::steady_clock::now();
 
-        return true;
+    // the scene's multi-draw goes out before the batches, so the pass takes the program's place
+    const uint32_t scenePass = 0;
+    const uint32_t batchPass = 1;
+    const GLuint sceneVao = ShapeCreator::UGeometry().Vao();
+
+    gRenderQueue.Clear();
+    for (MeshStore::Handle h = 0; h < store.Size(); ++h)
+    {
+        if (!gSceneVisible[h])
+            continue;
+
+        // nearest point of the bounding sphere along the view direction
+        const float depth = -(view * glm::vec4(store.sphereX[h], store.sphereY[h], store.sphereZ[h], 1.0f)).z - store.sphereRadius[h];
+        const GLuint texture = gUseTextureArrays ? 0 : store.textureId[h];
+        gRenderQueue.Add(RenderQueue::MakeKey(scenePass, texture, sceneVao, RenderQueue::QuantizeDepth(depth, NEAR_PLANE, FAR_PLANE)), h);
+    }
+
+    // batch items follow the scene handles
+    const uint32_t firstBatch = (uint32_t)store.Size();
+    for (size_t i : gBatchOrder)
+    {
+        const InstanceBatch& batch = gInstanceBatches[i];
+        const float depth = -UTransformBox(batch.Bounds(), view).max.z;
+        const GLuint texture = gUseTextureArrays ? 0 : batch.Texture();
+        gRenderQueue.Add(RenderQueue::MakeKey(batchPass, texture, batch.Vao(), RenderQueue::QuantizeDepth(depth, NEAR_PLANE, FAR_PLANE)),
+            firstBatch + (uint32_t)i);
+    }
+
+    gStateChangesUnsorted += gRenderQueue.StateChanges();
+    gRenderQueue.Sort();
+    gStateChangesSorted += gRenderQueue.StateChanges();
+
+    gSceneOrder.clear();
+    gBatchOrder.clear();
+    for (uint32_t item : gRenderQueue.Items())
+    {
+        if (item < firstBatch)
+            gSceneOrder.push_back(item);
+        else
+            gBatchOrder.push_back(item - firstBatch);
     }
 
-    // Error loading the image
-    return false;
+    ++gQueueFrames;
+    gQueuedDraws += gRenderQueue.Size();
+    gQueueMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 }
 
 
-void UDestroyTexture(GLuint textureId)
+/*One instanced draw per visible batch and level of detail, in queue order, of only the visible instances*/
+void UDrawBatches(const GeometryPool& geometry, const ShaderProgram& program)
 {
-    glGenTextures(1, &textureId);
+    for (size_t i : gBatchOrder)
+    {
+        InstanceBatch& batch = gInstanceBatches[i];
+        // every instance of a batch samples the same array
+        if (gUseTextureArrays && program.textureArrayLoc >= 0)
+            glUniform1ui(program.textureArrayLoc, UTextureSlotArray(batch.TextureSlot()));
+        batch.Draw(geometry, !gUseTextureArrays, &gBatchVisible[i], &gBatchLevels[i]);
+    }
 }
 
 
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint &programId)
+/*Instance batch that a SceneBVH object past the scene meshes belongs to*/
+size_t UBatchOfObject(uint32_t object)
 {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
+    return upper_bound(gBatchFirstObject.begin(), gBatchFirstObject.end(), (size_t)object) - gBatchFirstObject.begin() - 1;
+}
 
-    // Create a Shader program object.
-    programId = glCreateProgram();
 
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+/*World radius of a round shape's cross section, which ShapeCreator builds in the local xy plane*/
+float ULodRadius(const MeshAuthoring& mesh, const glm::mat4& model)
+{
+    return mesh.radius * max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])));
+}
 
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
 
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
+/*Scatter point lights of random colors just above the scene meshes*/
+void UCreatePointLights(vector<PointLight>& lights, int count)
+{
+    lights.clear();
+    if (count <= 0 || gScene.Size() == 0)
+        return;
+
+    BoundingBox area = gScene.Get(0).worldBox;
+    for (MeshStore::Handle h = 1; h < gScene.Size(); ++h)
+        area = UMergeBoxes(area, gScene.Get(h).worldBox);
+
+    // the same lights every run, so benchmarks compare
+    mt19937 random(330);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int i = 0; i < count; ++i)
     {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        PointLight light;
+        light.positionRadius = glm::vec4(
+            area.min.x + unit(random) * (area.max.x - area.min.x),
+            area.min.y + 0.2f + unit(random) * 1.5f,
+            area.min.z + unit(random) * (area.max.z - area.min.z),
+            1.5f + unit(random) * 2.5f);
+        light.color = glm::vec4(0.3f + 0.7f * unit(random), 0.3f + 0.7f * unit(random), 0.3f + 0.7f * unit(random), 1.0f) * 2.0f;
+        lights.push_back(light);
+    }
+    cout << "INFO: " << count << " point lights" << endl;
+}
 
-        return false;
+
+/*Shadow map of the key light over everything the scene holds at startup*/
+void UCreateShadowMap()
+{
+    if (gShadowPolicy == SHADOW_OFF)
+        return;
+
+    if (!gShadowMap.Create(gShadowResolution))
+    {
+        cout << "WARNING: could not create a " << gShadowResolution << " shadow map, shadows are off" << endl;
+        gShadowPolicy = SHADOW_OFF;
+        return;
     }
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
+    // the light frustum stays fitted to this area; casters moving outside it never invalidate the cache
+    gShadowCasterBoxes = USceneObjectBounds();
+    gShadowArea = gShadowCasterBoxes[0];
+    for (const auto& box : gShadowCasterBoxes)
+        gShadowArea = UMergeBoxes(gShadowArea, box);
+    gShadowSceneVersion = gScene.Version();
+    gShadowBatchVersion = 0;
+    for (auto& batch : gInstanceBatches)
+        gShadowBatchVersion += batch.Version();
+}
+
+
+/*Render what is stale in the key light's shadow map and fill in the frame's shadow data*/
+void UDrawShadows(FrameData& frame)
+{
+    frame.keyLightDirection = glm::vec4(glm::normalize(gKeyLightPosition), gKeyLightIntensity);
+    frame.shadowParams = glm::vec4(0.0f);
+    if (gShadowPolicy == SHADOW_OFF)
+        return;
+
+    gShadowMap.SetLight(gKeyLightPosition, gShadowArea);
+
+    // a moved caster only matters when it was or is inside the light frustum
+    unsigned batchVersion = 0;
+    for (auto& batch : gInstanceBatches)
+        batchVersion += batch.Version();
+    if (gScene.Version() != gShadowSceneVersion || batchVersion != gShadowBatchVersion)
     {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        vector<BoundingBox> boxes = USceneObjectBounds();
+        Frustum lightFrustum;
+        lightFrustum.Extract(gShadowMap.ViewProjection());
+        for (size_t i = 0; i < boxes.size() && gShadowMap.StaticValid(); ++i)
+        {
+            const bool moved = i >= gShadowCasterBoxes.size() || boxes[i].min != gShadowCasterBoxes[i].min || boxes[i].max != gShadowCasterBoxes[i].max;
+            if (moved && (lightFrustum.TestBox(boxes[i]) || (i < gShadowCasterBoxes.size() && lightFrustum.TestBox(gShadowCasterBoxes[i]))))
+                gShadowMap.Invalidate();
+        }
+        gShadowCasterBoxes = move(boxes);
+        gShadowSceneVersion = gScene.Version();
+        gShadowBatchVersion = batchVersion;
+    }
 
-        return false;
+    const glm::mat4& lampModel = gGizmos.Hot().model[gSpotLightGizmo];
+    const bool renderStatic = gShadowPolicy == SHADOW_ALWAYS || !gShadowMap.StaticValid();
+    const bool renderDynamic = renderStatic || lampModel != gShadowLampModel;
+    if (renderDynamic)
+    {
+        // the scene's vertex shaders, seen from the light
+        FrameData shadowFrame = frame;
+        shadowFrame.view = glm::mat4(1.0f);
+        shadowFrame.projection = gShadowMap.ViewProjection();
+        gFrameUniforms.Update(shadowFrame);
+
+        const GeometryPool& geometry = ShapeCreator::UGeometry();
+        if (renderStatic)
+        {
+            gShadowMap.BeginStatic();
+            UStateCache().UseProgram(gShadowProgram.id);
+            gSceneDraws.SubmitAll(geometry);
+            UStateCache().UseProgram(gShadowInstancedProgram.id);
+            for (auto& batch : gInstanceBatches)
+                batch.Draw(geometry, false);
+            gShadowMap.EndPass();
+        }
+
+        gShadowMap.BeginDynamic();
+        UStateCache().UseProgram(gShadowLampProgram.id);
+        UStateCache().BindVertexArray(geometry.Vao());
+        glDrawElementsBaseVertex(GL_TRIANGLES, gGizmos.Hot().indexCount[gSpotLightGizmo], geometry.IndexType(),
+            geometry.IndexOffset(gGizmos.Hot().firstIndex[gSpotLightGizmo]), gGizmos.Hot().baseVertex[gSpotLightGizmo]);
+        gShadowMap.EndPass();
+        gShadowLampModel = lampModel;
     }
+    gShadowMap.CountFrame(renderStatic, renderDynamic);
+    gShadowMap.Bind(SHADOW_MAP_UNIT);
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
+    frame.shadowMatrix = gShadowMap.ShadowMatrix();
+    frame.shadowParams = glm::vec4(1.0f, (float)(max(gShadowPcf, 1) / 2), 1.0f / gShadowMap.Resolution(), 0.0005f);
+}
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
+
+/*Build the hierarchy over the scene once every mesh and instance is in place*/
+void UBuildSceneBVH()
+{
+    gBatchFirstObject.clear();
+    size_t objects = gScene.Size();
+    for (auto& batch : gInstanceBatches)
     {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        gBatchFirstObject.push_back(objects);
+        objects += batch.Size();
+    }
+    gBatchVisible.assign(gInstanceBatches.size(), vector<GLuint>());
+    gBatchLevels.assign(gInstanceBatches.size(), vector<uint8_t>());
+
+    const double start = UGetTime();
+    gSceneBVH.Build(USceneObjectBounds());
+
+    // the tree starts from where everything is now
+    gScene.ClearMoved();
+    for (auto& batch : gInstanceBatches)
+        batch.ClearMoved();
+
+    // a chain per scene mesh and per batch, then every object points at its own
+    gLods.Clear();
+    gLods.SetMaxError(gLodError);
+    gLods.SetBudget(gTriangleBudget);
+    for (MeshStore::Handle h = 0; h < gScene.Size(); ++h)
+    {
+        gLods.AddChain(gScene.Get(h).lods);
+        gLods.SetObject(h, h, gScene.Get(h).worldSphere, ULodRadius(gScene.Get(h).authoring, gScene.Hot().model[h]));
+    }
+    gBatchLodChain.clear();
+    for (size_t b = 0; b < gInstanceBatches.size(); ++b)
+    {
+        const InstanceBatch& batch = gInstanceBatches[b];
+        const uint32_t chain = gLods.AddChain(batch.Base().lods);
+        gBatchLodChain.push_back(chain);
+        for (size_t i = 0; i < batch.Size(); ++i)
+            gLods.SetObject((uint32_t)(gBatchFirstObject[b] + i), chain, UTransformSphere(batch.Base().localSphere, batch.Model(i)), ULodRadius(batch.Base(), batch.Model(i)));
+    }
 
-        return false;
+    cout << "INFO: Scene BVH: " << gSceneBVH.Objects() << " objects, " << gSceneBVH.Nodes() << " nodes, depth "
+         << gSceneBVH.Depth() << ", built in " << (UGetTime() - start) * 1000.0 << " ms" << endl;
+}
+
+
+/*Report the nearest mesh under the cursor (the screen center while the cursor is captured)*/
+void UPickObject(GLFWwindow* window)
+{
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    double x = width * 0.5, y = height * 0.5;
+    if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED)
+        glfwGetCursorPos(window, &x, &y);
+
+    // a ray from the near plane to the far plane through the pixel
+    const glm::vec4 viewport(0.0f, 0.0f, (float)width, (float)height);
+    const glm::mat4 view = gCamera.GetViewMatrix();
+    const glm::mat4 projection = UProjection();
+    const glm::vec3 nearPoint = glm::unProject(glm::vec3(x, height - y, 0.0f), view, projection, viewport);
+    const glm::vec3 farPoint = glm::unProject(glm::vec3(x, height - y, 1.0f), view, projection, viewport);
+    const glm::vec3 direction = glm::normalize(farPoint - nearPoint);
+
+    // boxes only narrow it down; the triangles decide, tested in the mesh's own space where a
+    // point keeps the same t because the direction goes through the same affine inverse
+    const GeometryPool& geometry = ShapeCreator::UGeometry();
+    auto hitObject = [&](uint32_t object, float& distance) {
+        GLuint firstIndex, indexCount;
+        GLint baseVertex;
+        glm::mat4 model;
+        if (object < gScene.Size())
+        {
+            const RenderStore& hot = gScene.Hot();
+            firstIndex = hot.firstIndex[object];
+            indexCount = hot.indexCount[object];
+            baseVertex = hot.baseVertex[object];
+            model = hot.model[object];
+        }
+        else
+        {
+            const size_t batch = UBatchOfObject(object);
+            const GLMesh& mesh = gInstanceBatches[batch].Base();
+            firstIndex = mesh.firstIndex;
+            indexCount = mesh.nIndices;
+            baseVertex = mesh.baseVertex;
+            model = gInstanceBatches[batch].Model(object - gBatchFirstObject[batch]);
+        }
+        const glm::mat4 inverse = UAffineInverse(model);
+        const glm::vec3 localOrigin(inverse * glm::vec4(nearPoint, 1.0f));
+        const glm::vec3 localDirection(inverse * glm::vec4(direction, 0.0f));
+        return geometry.Raycast(firstIndex, indexCount, baseVertex, localOrigin, localDirection, distance);
+    };
+
+    const auto start = chrono::steady_clock::now();
+    float distance = glm::distance(nearPoint, farPoint);
+    const int64_t object = gSceneBVH.Raycast(nearPoint, direction, distance, hitObject);
+    const double microseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+    if (object < 0)
+    {
+        cout << "Picked nothing (" << microseconds << " us)" << endl;
+        return;
     }
+    const MeshAuthoring& mesh = object < (int64_t)gScene.Size() ? gScene.Get((MeshStore::Handle)object).authoring
+        : gInstanceBatches[UBatchOfObject((uint32_t)object)].Base();
+    cout << "Picked " << mesh.shape << " " << object << " (" << mesh.texFilename << ") at distance " << distance << " (" << microseconds << " us)" << endl;
+}
 
-    glUseProgram(programId);    // Uses the shader program
 
-    return true;
+/*Copy the scene's textures into texture arrays and point every draw at its layer*/
+void UBuildTextureArrays()
+{
+    vector<GLuint> textures;
+    for (MeshStore::Handle h = 0; h < gScene.Size(); ++h)
+        textures.push_back(gScene.Hot().textureId[h]);
+    for (auto& batch : gInstanceBatches)
+        textures.push_back(batch.Texture());
+
+    if (gUseTextureArrays && !gTextureArrays.Build(textures))
+    {
+        cout << "Falling back to one texture bind per batch" << endl;
+        gUseTextureArrays = false;
+    }
+
+    for (auto& batch : gInstanceBatches)
+        batch.SetTextureSlot(gUseTextureArrays ? gTextureArrays.Slot(batch.Texture()) : 0);
+
+    for (ShaderProgram* program : { &gKeyLightProgram, &gInstancedProgram })
+    {
+        UStateCache().UseProgram(program->id);
+        glUniform1i(program->Uniform("useTextureArrays"), gUseTextureArrays);
+    }
+    UStateCache().UseProgram(0);
+
+    // the per-draw slots have changed
+    gSceneDrawsVersion = ~0u;
+}
+
+
+/*Generate and load the texture, or share the one already loaded from the same image*/
+bool UCreateTexture(const char* filename, GLuint &textureId)
+{
+    return gTextures.Acquire(filename, textureId);
+}
+
+
+void UDestroyTexture(GLuint textureId)
+{
+    gTextures.Release(textureId);
 }
 
 
-void UDestroyShaderProgram(GLuint programId)
+/*One sampler object per wrap mode, with the filtering the textures are created with*/
+void UCreateWrapSamplers()
 {
-    glDeleteProgram(programId);
+    glGenSamplers(4, gWrapSamplers);
+    for (int i = 0; i < 4; ++i)
+    {
+        glSamplerParameteri(gWrapSamplers[i], GL_TEXTURE_WRAP_S, WRAP_MODES[i]);
+        glSamplerParameteri(gWrapSamplers[i], GL_TEXTURE_WRAP_T, WRAP_MODES[i]);
+        glSamplerParameteri(gWrapSamplers[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glSamplerParameteri(gWrapSamplers[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    float color[] = {1.0f, 0.0f, 1.0f, 1.0f};
+    glSamplerParameterfv(gWrapSamplers[3], GL_TEXTURE_BORDER_COLOR, color);
+}
+
+
+/*Sampler object of a wrap mode*/
+GLuint UWrapSampler(GLint wrapMode)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        if (WRAP_MODES[i] == wrapMode)
+            return gWrapSamplers[i];
+    }
+    return gWrapSamplers[0];
+}
+
+
+// Sampler units and switches of a program that has just linked, at startup or after a reload
+void UConfigureProgram(ShaderProgram& program)
+{
+    UStateCache().UseProgram(program.id);
+
+    // We set the texture as texture unit 0
+    glUniform1i(program.Uniform("uTexture"), 0);
+
+    // and the texture arrays to the units after it
+    GLint arrayUnits[MAX_TEXTURE_ARRAYS];
+    for (GLuint i = 0; i < MAX_TEXTURE_ARRAYS; ++i)
+        arrayUnits[i] = TEXTURE_ARRAY_UNIT + i;
+    glUniform1iv(program.Uniform("uTextureArrays"), MAX_TEXTURE_ARRAYS, arrayUnits);
+    glUniform1i(program.Uniform("uShadowMap"), SHADOW_MAP_UNIT);
+    glUniform1i(program.Uniform("useTextureArrays"), gUseTextureArrays);
 }
@@ -0,0 +1,429 @@
+// Bakes the scene textures into block-compressed KTX2 files at build time:
+//   texture_baker OUTPUT_DIR IMAGE...
+// Every image is flipped for OpenGL, given a box-filtered mip chain down to 1x1 and
+// encoded to BC1 (opaque) or BC3 (with alpha), so the application can map the file
+// and hand the levels to glCompressedTexImage2D without decoding anything.
+#include <iostream>         // cout, cerr
+#include <algorithm>        // min, max
+#include <chrono>           // baking time
+#include <cmath>            // fabsf
+#include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // memcpy
+#include <string>
+#include <vector>
+#include <sys/stat.h>       // modification times
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>      // Image loading Utility functions
+
+#include "./tutorial_05_04/Ktx2File.h"
+
+using namespace std;
+
+namespace
+{
+    const char* const BAKER_NAME = "CS330 texture_baker";
+
+    // one mip level, four floats per texel
+    struct Level
+    {
+        int width = 0;
+        int height = 0;
+        vector<float> texels;
+    };
+}
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
+void UFlipImageVertically(unsigned char* image, int width, int height, int channels)
+{
+    const size_t rowBytes = (size_t)width * channels;
+    vector<unsigned char> row(rowBytes);
+    for (int j = 0; j < height / 2; ++j)
+    {
+        unsigned char* top = image + j * rowBytes;
+        unsigned char* bottom = image + (height - 1 - j) * rowBytes;
+        memcpy(row.data(), top, rowBytes);
+        memcpy(top, bottom, rowBytes);
+        memcpy(bottom, row.data(), rowBytes);
+    }
+}
+
+// the full mip chain, each level a 2x2 box filter of the one above (like glGenerateMipmap)
+vector<Level> UBuildMipChain(const unsigned char* rgba, int width, int height)
+{
+    vector<Level> chain(1);
+    chain[0].width = width;
+    chain[0].height = height;
+    chain[0].texels.assign(rgba, rgba + (size_t)width * height * 4);
+
+    while (chain.back().width > 1 || chain.back().height > 1)
+    {
+        const Level& above = chain.back();
+        Level level;
+        level.width = max(1, above.width / 2);
+        level.height = max(1, above.height / 2);
+        level.texels.resize((size_t)level.width * level.height * 4);
+
+        for (int y = 0; y < level.height; ++y)
+        {
+            // an odd row or column at the edge is folded into the last texel
+            const int y0 = min(2 * y, above.height - 1), y1 = min(2 * y + 1, above.height - 1);
+            for (int x = 0; x < level.width; ++x)
+            {
+                const int x0 = min(2 * x, above.width - 1), x1 = min(2 * x + 1, above.width - 1);
+                for (int c = 0; c < 4; ++c)
+                {
+                    const float sum = above.texels[((size_t)y0 * above.width + x0) * 4 + c] + above.texels[((size_t)y0 * above.width + x1) * 4 + c]
+                        + above.texels[((size_t)y1 * above.width + x0) * 4 + c] + above.texels[((size_t)y1 * above.width + x1) * 4 + c];
+                    level.texels[((size_t)y * level.width + x) * 4 + c] = sum * 0.25f;
+                }
+            }
+        }
+        chain.push_back(move(level));
+    }
+    return chain;
+}
+
+unsigned short UPack565(const float color[3])
+{
+    const int r = (int)(min(max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    const int g = (int)(min(max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    const int b = (int)(min(max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+void UUnpack565(unsigned short packed, float color[3])
+{
+    color[0] = ((packed >> 11) & 31) * 255.0f / 31.0f;
+    color[1] = ((packed >> 5) & 63) * 255.0f / 63.0f;
+    color[2] = (packed & 31) * 255.0f / 31.0f;
+}
+
+// index of the nearest of the four BC1 colours for every texel
+unsigned int UPickColorIndices(const float texels[16][4], unsigned short c0, unsigned short c1)
+{
+    float palette[4][3];
+    UUnpack565(c0, palette[0]);
+    UUnpack565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    unsigned int indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        float bestDistance = 1e30f;
+        for (int p = 0; p < 4; ++p)
+        {
+            float distance = 0.0f;
+            for (int c = 0; c < 3; ++c)
+                distance += (texels[i][c] - palette[p][c]) * (texels[i][c] - palette[p][c]);
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = p;
+            }
+        }
+        indices |= (unsigned int)best << (2 * i);
+    }
+    return indices;
+}
+
+// 8 bytes of BC1 in four colour mode: endpoints along the principal axis of the block,
+// then refitted once by least squares to the indices they produced
+void UEncodeColorBlock(const float texels[16][4], unsigned char* out)
+{
+    float mean[3] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += texels[i][c] / 16.0f;
+
+    float covariance[6] = {};
+    for (int i = 0; i < 16; ++i)
+    {
+        const float d[3] = { texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2] };
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+
+    // a few power iterations are plenty for a 3x3 matrix
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        const float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+        const float length = max(max(fabsf(next[0]), fabsf(next[1])), fabsf(next[2]));
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < 3; ++c)
+            axis[c] = next[c] / length;
+    }
+
+    float lowest = 1e30f, highest = -1e30f;
+    for (int i = 0; i < 16; ++i)
+    {
+        const float t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+        lowest = min(lowest, t);
+        highest = max(highest, t);
+    }
+    const float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float endpoints[2][3];
+    for (int c = 0; c < 3; ++c)
+    {
+        endpoints[0][c] = mean[c] + axis[c] * highest / max(axisLength, 1e-6f);
+        endpoints[1][c] = mean[c] + axis[c] * lowest / max(axisLength, 1e-6f);
+    }
+
+    unsigned short c0 = UPack565(endpoints[0]);
+    unsigned short c1 = UPack565(endpoints[1]);
+    unsigned int indices = UPickColorIndices(texels, c0, c1);
+
+    // weight of c0 for each index: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+    for (int i = 0; i < 16; ++i)
+    {
+        const float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; ++c)
+        {
+            ax[c] += a * texels[i][c];
+            bx[c] += b * texels[i][c];
+        }
+    }
+    const float determinant = aa * bb - ab * ab;
+    if (fabsf(determinant) > 1e-4f)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            endpoints[0][c] = (ax[c] * bb - bx[c] * ab) / determinant;
+            endpoints[1][c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        }
+        const unsigned short refit0 = UPack565(endpoints[0]);
+        const unsigned short refit1 = UPack565(endpoints[1]);
+        const unsigned int refitIndices = UPickColorIndices(texels, refit0, refit1);
+
+        // keep whichever pair reproduces the block better
+        float error[2] = {};
+        const unsigned short pairs[2][2] = { { c0, c1 }, { refit0, refit1 } };
+        const unsigned int pairIndices[2] = { indices, refitIndices };
+        for (int candidate = 0; candidate < 2; ++candidate)
+        {
+            float palette[4][3];
+            UUnpack565(pairs[candidate][0], palette[0]);
+            UUnpack565(pairs[candidate][1], palette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+            }
+            for (int i = 0; i < 16; ++i)
+            {
+                const float* p = palette[(pairIndices[candidate] >> (2 * i)) & 3];
+                for (int c = 0; c < 3; ++c)
+                    error[candidate] += (texels[i][c] - p[c]) * (texels[i][c] - p[c]);
+            }
+        }
+        if (error[1] < error[0])
+        {
+            c0 = refit0;
+            c1 = refit1;
+            indices = refitIndices;
+        }
+    }
+
+    // c0 > c1 selects the four colour mode; swapping the endpoints swaps 0<->1 and 2<->3
+    if (c0 < c1)
+    {
+        swap(c0, c1);
+        indices ^= 0x55555555;
+    }
+    else if (c0 == c1)
+        indices = 0;
+
+    memcpy(out, &c0, 2);
+    memcpy(out + 2, &c1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+// 8 bytes of BC3 alpha: the block's extremes as endpoints with six steps between them
+void UEncodeAlphaBlock(const float texels[16][4], unsigned char* out)
+{
+    float lowest = 255.0f, highest = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        lowest = min(lowest, texels[i][3]);
+        highest = max(highest, texels[i][3]);
+    }
+    const int a0 = (int)(min(max(highest, 0.0f), 255.0f) + 0.5f);
+    const int a1 = (int)(min(max(lowest, 0.0f), 255.0f) + 0.5f);
+
+    // code 0 is a0, 1 is a1 and 2..7 step from a0 towards a1
+    float palette[8] = { (float)a0, (float)a1 };
+    for (int code = 2; code < 8; ++code)
+        palette[code] = ((8 - code) * a0 + (code - 1) * a1) / 7.0f;
+
+    uint64_t indices = 0;
+    if (a0 > a1)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0;
+            for (int code = 1; code < 8; ++code)
+                if (fabsf(texels[i][3] - palette[code]) < fabsf(texels[i][3] - palette[best]))
+                    best = code;
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// one level in 4x4 blocks, edge texels repeated into the blocks past the image
+vector<unsigned char> UEncodeLevel(const Level& level, uint32_t vkFormat)
+{
+    const int blocksWide = (level.width + 3) / 4, blocksHigh = (level.height + 3) / 4;
+    const uint32_t blockBytes = UKtx2BlockBytes(vkFormat);
+    vector<unsigned char> encoded((size_t)blocksWide * blocksHigh * blockBytes);
+
+    unsigned char* out = encoded.data();
+    for (int by = 0; by < blocksHigh; ++by)
+    {
+        for (int bx = 0; bx < blocksWide; ++bx)
+        {
+            float texels[16][4];
+            for (int i = 0; i < 16; ++i)
+            {
+                const int x = min(bx * 4 + i % 4, level.width - 1), y = min(by * 4 + i / 4, level.height - 1);
+                memcpy(texels[i], &level.texels[((size_t)y * level.width + x) * 4], sizeof(texels[i]));
+            }
+
+            if (vkFormat == KTX2_FORMAT_BC3_UNORM)
+            {
+                UEncodeAlphaBlock(texels, out);
+                UEncodeColorBlock(texels, out + 8);
+            }
+            else
+                UEncodeColorBlock(texels, out);
+            out += blockBytes;
+        }
+    }
+    return encoded;
+}
+
+// modification time of a file, 0 when it does not exist
+long long UModifiedTime(const string& filename)
+{
+    struct stat status;
+    return stat(filename.c_str(), &status) == 0 ? (long long)status.st_mtime : 0;
+}
+
+// "dir/name.png" -> "name"
+string UBaseName(const string& filename)
+{
+    const size_t slash = filename.find_last_of("/\\");
+    const size_t start = slash == string::npos ? 0 : slash + 1;
+    const size_t dot = filename.find_last_of('.');
+    return filename.substr(start, dot == string::npos || dot < start ? string::npos : dot - start);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "usage: texture_baker OUTPUT_DIR IMAGE..." << endl;
+        return EXIT_FAILURE;
+    }
+    const string outputDir = argv[1];
+
+    size_t baked = 0, upToDate = 0, failed = 0;
+    size_t sourceBytes = 0, bakedBytes = 0, rawVramBytes = 0, bakedVramBytes = 0;
+    const auto start = chrono::steady_clock::now();
+
+    for (int arg = 2; arg < argc; ++arg)
+    {
+        const string source = argv[arg];
+        const string target = outputDir + "/" + UBaseName(source) + ".ktx2";
+
+        // only images that changed since their last bake
+        const long long sourceTime = UModifiedTime(source);
+        if (sourceTime != 0 && UModifiedTime(target) >= sourceTime)
+        {
+            ++upToDate;
+            continue;
+        }
+
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(source.c_str(), &width, &height, &channels, 4);
+        if (!pixels || (channels != 3 && channels != 4))
+        {
+            // the application cannot load these either
+            cerr << "ERROR: could not bake " << source << " (" << (pixels ? "not an RGB or RGBA image" : stbi_failure_reason()) << ")" << endl;
+            stbi_image_free(pixels);
+            ++failed;
+            continue;
+        }
+        UFlipImageVertically(pixels, width, height, 4);
+
+        // BC1 holds no alpha; an RGBA image that is opaque everywhere does not need it either
+        bool opaque = true;
+        for (size_t i = 3; opaque && i < (size_t)width * height * 4; i += 4)
+            opaque = pixels[i] == 255;
+        const uint32_t vkFormat = opaque ? KTX2_FORMAT_BC1_RGB_UNORM : KTX2_FORMAT_BC3_UNORM;
+
+        const vector<Level> chain = UBuildMipChain(pixels, width, height);
+        stbi_image_free(pixels);
+
+        vector<vector<unsigned char>> levels;
+        size_t levelBytes = 0;
+        for (const Level& level : chain)
+        {
+            levels.push_back(UEncodeLevel(level, vkFormat));
+            levelBytes += levels.back().size();
+        }
+
+        if (!UWriteKtx2(target, vkFormat, width, height, levels, BAKER_NAME))
+        {
+            cerr << "ERROR: could not write " << target << endl;
+            ++failed;
+            continue;
+        }
+
+        // what the runtime path keeps resident: RGB8 is padded to four bytes, the mip chain adds a third
+        const size_t rawBytes = (size_t)width * height * 4 * 4 / 3;
+        struct stat sourceStatus, targetStatus;
+        stat(source.c_str(), &sourceStatus);
+        stat(target.c_str(), &targetStatus);
+        cout << "  " << UBaseName(source) << ": " << width << "x" << height << " "
+             << (opaque ? "BC1" : "BC3") << ", " << chain.size() << " levels, " << sourceStatus.st_size / 1024 << " -> "
+             << targetStatus.st_size / 1024 << " KiB on disk, " << rawBytes / 1024 << " -> " << levelBytes / 1024 << " KiB in VRAM" << endl;
+
+        ++baked;
+        sourceBytes += (size_t)sourceStatus.st_size;
+        bakedBytes += (size_t)targetStatus.st_size;
+        rawVramBytes += rawBytes;
+        bakedVramBytes += levelBytes;
+    }
+
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "INFO: Baked " << baked << " textures in " << seconds << " s (" << upToDate << " up to date, " << failed << " failed)";
+    if (baked > 0)
+        cout << ": " << sourceBytes / 1024 << " -> " << bakedBytes / 1024 << " KiB on disk, "
+             << rawVramBytes / 1024 << " -> " << bakedVramBytes / 1024 << " KiB in VRAM";
+    cout << endl;
+
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Bounds.h"
+
+using namespace std;
+
+void UComputeBounds(const vector<float>& vertices, GLuint floatsPerVertex, BoundingBox& box, BoundingSphere& sphere)
+{
+	if (vertices.size() < floatsPerVertex)
+	{
+		box = BoundingBox();
+		sphere = BoundingSphere();
+		return;
+	}
+
+	box.min = box.max = glm::vec3(vertices[0], vertices[1], vertices[2]);
+	for (size_t i = 0; i + 2 < vertices.size(); i += floatsPerVertex)
+	{
+		const glm::vec3 position(vertices[i], vertices[i + 1], vertices[i + 2]);
+		box.min = glm::min(box.min, position);
+		box.max = glm::max(box.max, position);
+	}
+
+	// centered on the box, but only as large as the farthest vertex needs
+	sphere.center = (box.min + box.max) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i + 2 < vertices.size(); i += floatsPerVertex)
+	{
+		const glm::vec3 offset = glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]) - sphere.center;
+		radiusSquared = max(radiusSquared, glm::dot(offset, offset));
+	}
+	sphere.radius = sqrt(radiusSquared);
+}
+
+BoundingBox UTransformBox(const BoundingBox& box, const glm::mat4& model)
+{
+	const glm::vec3 center = glm::vec3(model * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+	const glm::vec3 extents = (box.max - box.min) * 0.5f;
+
+	// each world axis picks up the absolute contribution of every local axis
+	const glm::mat3 rotationScale(model);
+	glm::vec3 worldExtents(0.0f);
+	for (int column = 0; column < 3; ++column)
+		worldExtents += glm::abs(rotationScale[column]) * extents[column];
+
+	BoundingBox result;
+	result.min = center - worldExtents;
+	result.max = center + worldExtents;
+	return result;
+}
+
+BoundingSphere UTransformSphere(const BoundingSphere& sphere, const glm::mat4& model)
+{
+	const float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+	BoundingSphere result;
+	result.center = glm::vec3(model * glm::vec4(sphere.center, 1.0f));
+	result.radius = sphere.radius * scale;
+	return result;
+}
+
+BoundingBox UMergeBoxes(const BoundingBox& a, const BoundingBox& b)
+{
+	BoundingBox result;
+	result.min = glm::min(a.min, b.min);
+	result.max = glm::max(a.max, b.max);
+	return result;
+}
+
+bool URayIntersectsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const BoundingBox& box, float maxDistance, float& entry)
+{
+	const glm::vec3 t0 = (box.min - origin) * inverseDirection;
+	const glm::vec3 t1 = (box.max - origin) * inverseDirection;
+	const glm::vec3 nearest = glm::min(t0, t1);
+	const glm::vec3 farthest = glm::max(t0, t1);
+
+	entry = max(max(nearest.x, nearest.y), max(nearest.z, 0.0f));
+	const float exit = min(min(farthest.x, farthest.y), min(farthest.z, maxDistance));
+	return entry <= exit;
+}
+
+bool URayIntersectsTriangle(const glm::vec3& origin, const glm::vec3& direction,
+	const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float& distance)
+{
+	const glm::vec3 edge1 = b - a;
+	const glm::vec3 edge2 = c - a;
+	const glm::vec3 p = glm::cross(direction, edge2);
+	const float determinant = glm::dot(edge1, p);
+	if (fabs(determinant) < 1e-12f)
+		return false;	// parallel to the triangle
+
+	const float inverseDeterminant = 1.0f / determinant;
+	const glm::vec3 s = origin - a;
+	const float u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	const glm::vec3 q = glm::cross(s, edge1);
+	const float v = glm::dot(direction, q) * inverseDeterminant;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	distance = glm::dot(edge2, q) * inverseDeterminant;
+	return distance >= 0.0f;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+// general includes
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+struct BoundingBox
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+};
+
+struct BoundingSphere
+{
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+};
+
+// box and sphere around the positions (first three floats) of an interleaved vertex stream
+void UComputeBounds(const std::vector<float>& vertices, GLuint floatsPerVertex, BoundingBox& box, BoundingSphere& sphere);
+
+// world-space box around a transformed box (center plus |M| * extents)
+BoundingBox UTransformBox(const BoundingBox& box, const glm::mat4& model);
+
+// the sphere grows by the largest scale of the model matrix
+BoundingSphere UTransformSphere(const BoundingSphere& sphere, const glm::mat4& model);
+
+// smallest box holding both
+BoundingBox UMergeBoxes(const BoundingBox& a, const BoundingBox& b);
+
+// slab test; inverseDirection is 1 / direction per axis. On a hit closer than maxDistance,
+// entry is where the ray enters the box (0 when it starts inside)
+bool URayIntersectsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const BoundingBox& box, float maxDistance, float& entry);
+
+// Moller-Trumbore, both faces; distance is in units of direction
+bool URayIntersectsTriangle(const glm::vec3& origin, const glm::vec3& direction,
+	const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float& distance);
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "FrameProfiler.h"
+
+using namespace std;
+
+static const char* const SCOPE_NAMES[PROFILE_SCOPE_COUNT] = { "input", "update", "submit", "swap" };
+
+void FrameProfiler::Create()
+{
+	for (auto& pending : queries)
+		glGenQueries(1, &pending.query);
+}
+
+void FrameProfiler::BeginFrame()
+{
+	current = Sample();
+	current.frame = frameNumber;
+	frameStart = Clock::now();
+}
+
+void FrameProfiler::EndFrame()
+{
+	current.cpu = chrono::duration<double, milli>(Clock::now() - frameStart).count();
+
+	samples.push_back(current);
+	if (samples.size() > MAX_SAMPLES)
+		samples.pop_front();
+	++frameNumber;
+
+	Resolve(false);
+}
+
+void FrameProfiler::Begin(ProfileScope scope)
+{
+	scopeStart[scope] = Clock::now();
+}
+
+void FrameProfiler::End(ProfileScope scope)
+{
+	current.scopes[scope] += chrono::duration<double, milli>(Clock::now() - scopeStart[scope]).count();
+}
+
+void FrameProfiler::BeginGpu()
+{
+	PendingQuery& pending = queries[nextQuery];
+	if (pending.active)
+	{
+		// the GPU is more than a ring behind; reading the result now waits for it
+		++stalls;
+		Resolve(true);
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, pending.query);
+	pending.frame = frameNumber;
+	pending.active = true;
+}
+
+void FrameProfiler::EndGpu()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	nextQuery = (nextQuery + 1) % QUERY_RING_SIZE;
+}
+
+void FrameProfiler::Resolve(bool wait)
+{
+	// oldest first, so a wait only ever blocks on the query that is needed next
+	for (size_t i = 0; i < QUERY_RING_SIZE; ++i)
+	{
+		PendingQuery& pending = queries[(nextQuery + i) % QUERY_RING_SIZE];
+		if (!pending.active)
+			continue;
+
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available && !(wait && i == 0))
+			break;
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(pending.query, GL_QUERY_RESULT, &nanoseconds);
+		pending.active = false;
+
+		if (!samples.empty() && pending.frame >= samples.front().frame && pending.frame <= samples.back().frame)
+			samples[pending.frame - samples.front().frame].gpu = nanoseconds / 1.0e6;
+	}
+}
+
+double FrameProfiler::Percentile(vector<double> values, double percentile)
+{
+	if (values.empty())
+		return 0.0;
+
+	// nearest rank
+	sort(values.begin(), values.end());
+	size_t rank = (size_t)ceil(percentile / 100.0 * values.size());
+	return values[min(values.size(), max<size_t>(rank, 1)) - 1];
+}
+
+double FrameProfiler::CpuPercentile(double percentile) const
+{
+	vector<double> values;
+	for (const auto& sample : samples)
+		values.push_back(sample.cpu);
+	return Percentile(values, percentile);
+}
+
+double FrameProfiler::ScopePercentile(ProfileScope scope, double percentile) const
+{
+	vector<double> values;
+	for (const auto& sample : samples)
+		values.push_back(sample.scopes[scope]);
+	return Percentile(values, percentile);
+}
+
+double FrameProfiler::GpuPercentile(double percentile) const
+{
+	vector<double> values;
+	for (const auto& sample : samples)
+	{
+		if (sample.gpu >= 0.0)
+			values.push_back(sample.gpu);
+	}
+	return Percentile(values, percentile);
+}
+
+void FrameProfiler::Report(ostream& out) const
+{
+	out << "INFO: Frame times over the last " << samples.size() << " frames (ms, p50 / p95 / p99)" << endl;
+	out << fixed << setprecision(3);
+
+	auto line = [&out](const char* name, double p50, double p95, double p99) {
+		out << "  " << left << setw(10) << name << right
+			<< setw(9) << p50 << setw(9) << p95 << setw(9) << p99 << endl;
+	};
+
+	line("cpu frame", CpuPercentile(50), CpuPercentile(95), CpuPercentile(99));
+	for (int scope = 0; scope < PROFILE_SCOPE_COUNT; ++scope)
+	{
+		const ProfileScope s = (ProfileScope)scope;
+		line(SCOPE_NAMES[scope], ScopePercentile(s, 50), ScopePercentile(s, 95), ScopePercentile(s, 99));
+	}
+	line("gpu", GpuPercentile(50), GpuPercentile(95), GpuPercentile(99));
+
+	out << defaultfloat << "  timer query stalls: " << stalls << endl;
+}
+
+bool FrameProfiler::WriteCsv(const string& filename) const
+{
+	ofstream file(filename);
+	if (!file)
+		return false;
+
+	file << "frame,cpu_ms";
+	for (const char* name : SCOPE_NAMES)
+		file << "," << name << "_ms";
+	file << ",gpu_ms\n";
+
+	for (const auto& sample : samples)
+	{
+		file << sample.frame << "," << sample.cpu;
+		for (double scope : sample.scopes)
+			file << "," << scope;
+		file << ",";
+		if (sample.gpu >= 0.0)
+			file << sample.gpu;
+		file << "\n";
+	}
+	return true;
+}
+
+string FrameProfiler::Overlay() const
+{
+	ostringstream text;
+	text << fixed << setprecision(2)
+		<< "cpu " << CpuPercentile(50) << "/" << CpuPercentile(99) << " ms | gpu "
+		<< GpuPercentile(50) << "/" << GpuPercentile(99) << " ms (p50/p99)";
+	return text.str();
+}
+
+void FrameProfiler::Destroy()
+{
+	for (auto& pending : queries)
+	{
+		glDeleteQueries(1, &pending.query);
+		pending = PendingQuery();
+	}
+	samples.clear();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// general includes
+#include <chrono>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// parts of a frame timed on the CPU
+enum ProfileScope
+{
+	PROFILE_INPUT = 0,
+	PROFILE_UPDATE,
+	PROFILE_SUBMIT,
+	PROFILE_SWAP,
+	PROFILE_SCOPE_COUNT
+};
+
+// CPU scope timers plus a GL_TIME_ELAPSED query per frame, kept for the last
+// frames so the p50/p95/p99 frame times show whether the CPU or the GPU is the limit
+class FrameProfiler
+{
+public:
+	// queries are read back this many frames late, so reading them never waits on the GPU
+	static constexpr size_t QUERY_RING_SIZE = 4;
+
+	// frames kept for the percentiles and the CSV
+	static constexpr size_t MAX_SAMPLES = 10000;
+
+	void Create();
+
+	void BeginFrame();
+	void EndFrame();
+
+	// CPU time of one scope in the current frame; a scope may be entered more than once per frame
+	void Begin(ProfileScope scope);
+	void End(ProfileScope scope);
+
+	// GL work between these lands in the frame's GPU time
+	void BeginGpu();
+	void EndGpu();
+
+	// percentile (0-100) of the CPU frame time, a CPU scope, or the GPU time, in ms
+	double CpuPercentile(double percentile) const;
+	double ScopePercentile(ProfileScope scope, double percentile) const;
+	double GpuPercentile(double percentile) const;
+
+	// p50/p95/p99 of everything, one line per series
+	void Report(std::ostream& out) const;
+
+	// one row per frame: frame, cpu total, every scope, gpu (empty when not resolved)
+	bool WriteCsv(const std::string& filename) const;
+
+	// short "cpu p50/p99 | gpu p50/p99" line, for the window title
+	std::string Overlay() const;
+
+	// frames that had to wait for a query result because the ring was full
+	size_t Stalls() const { return stalls; }
+
+	void Destroy();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Sample
+	{
+		size_t frame = 0;
+		double cpu = 0.0;
+		double scopes[PROFILE_SCOPE_COUNT] = {};
+		double gpu = -1.0;	// negative until the query comes back
+	};
+
+	struct PendingQuery
+	{
+		GLuint query = 0;
+		size_t frame = 0;
+		bool active = false;
+	};
+
+	// reads back finished queries; with wait the oldest one is read even if it blocks
+	void Resolve(bool wait);
+	static double Percentile(std::vector<double> values, double percentile);
+
+	std::deque<Sample> samples;
+	Sample current;
+	Clock::time_point frameStart;
+	Clock::time_point scopeStart[PROFILE_SCOPE_COUNT];
+
+	PendingQuery queries[QUERY_RING_SIZE];
+	size_t nextQuery = 0;
+	size_t frameNumber = 0;
+	size_t stalls = 0;
+};
@@ -0,0 +1,114 @@
+#include "Frustum.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+void Frustum::Extract(const glm::mat4& viewProjection)
+{
+	// glm is column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	const glm::mat4 m = glm::transpose(viewProjection);
+
+	planes[0] = m[3] + m[0];	// left
+	planes[1] = m[3] - m[0];	// right
+	planes[2] = m[3] + m[1];	// bottom
+	planes[3] = m[3] - m[1];	// top
+	planes[4] = m[3] + m[2];	// near
+	planes[5] = m[3] - m[2];	// far
+
+	// unit normals, so plane distances compare directly with radii
+	for (auto& plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+}
+
+size_t Frustum::CullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count, uint8_t* visible) const
+{
+	size_t visibleCount = 0;
+	size_t i = 0;
+
+#ifdef FRUSTUM_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 cx = _mm_loadu_ps(x + i);
+		const __m128 cy = _mm_loadu_ps(y + i);
+		const __m128 cz = _mm_loadu_ps(z + i);
+		const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+		// a sphere is outside as soon as it is entirely behind one plane
+		__m128 inside = _mm_cmpeq_ps(negativeRadius, negativeRadius);
+		for (const auto& plane : planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(cz, _mm_set1_ps(plane.z)));
+			distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+			inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negativeRadius));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		BoundingSphere sphere;
+		sphere.center = glm::vec3(x[i], y[i], z[i]);
+		sphere.radius = radius[i];
+		visible[i] = TestSphere(sphere) ? 1 : 0;
+		visibleCount += visible[i];
+	}
+
+	return visibleCount;
+}
+
+bool Frustum::TestSphere(const BoundingSphere& sphere) const
+{
+	for (const auto& plane : planes)
+	{
+		if (glm::dot(glm::vec3(plane), sphere.center) + plane.w <= -sphere.radius)
+			return false;
+	}
+	return true;
+}
+
+FrustumTest Frustum::ClassifyBox(const BoundingBox& box) const
+{
+	FrustumTest result = FRUSTUM_INSIDE;
+	for (const auto& plane : planes)
+	{
+		const glm::vec3 normal(plane);
+
+		// farthest corner along the normal decides outside, the nearest one inside
+		const glm::vec3 positive(plane.x >= 0.0f ? box.max.x : box.min.x,
+			plane.y >= 0.0f ? box.max.y : box.min.y,
+			plane.z >= 0.0f ? box.max.z : box.min.z);
+		if (glm::dot(normal, positive) + plane.w < 0.0f)
+			return FRUSTUM_OUTSIDE;
+
+		const glm::vec3 negative(plane.x >= 0.0f ? box.min.x : box.max.x,
+			plane.y >= 0.0f ? box.min.y : box.max.y,
+			plane.z >= 0.0f ? box.min.z : box.max.z);
+		if (glm::dot(normal, negative) + plane.w < 0.0f)
+			result = FRUSTUM_INTERSECTS;
+	}
+	return result;
+}
+
+bool Frustum::TestBox(const BoundingBox& box) const
+{
+	// only the corner farthest along the plane normal needs to be checked
+	for (const auto& plane : planes)
+	{
+		const glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+			plane.y >= 0.0f ? box.max.y : box.min.y,
+			plane.z >= 0.0f ? box.max.z : box.min.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
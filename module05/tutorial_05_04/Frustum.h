@@ -0,0 +1,40 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+
+// result of testing a box against all six planes
+enum FrustumTest
+{
+	FRUSTUM_OUTSIDE = 0,
+	FRUSTUM_INTERSECTS,
+	FRUSTUM_INSIDE
+};
+
+// the six planes of a view-projection matrix, normals pointing inwards
+class Frustum
+{
+public:
+	// left, right, bottom, top, near, far from the rows of projection * view
+	void Extract(const glm::mat4& viewProjection);
+
+	// tests count spheres stored as separate x/y/z/radius arrays, four at a time
+	// with SSE where available; visible[i] becomes 1 or 0. Returns the visible count
+	size_t CullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count, uint8_t* visible) const;
+
+	bool TestSphere(const BoundingSphere& sphere) const;
+	bool TestBox(const BoundingBox& box) const;
+
+	// like TestBox, but also tells when nothing of the box can be outside
+	FrustumTest ClassifyBox(const BoundingBox& box) const;
+
+	const glm::vec4& Plane(int i) const { return planes[i]; }
+
+private:
+	glm::vec4 planes[6];
+};
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "Bounds.h"
+#include "GeometryPool.h"
+#include "StateCache.h"
+
+using namespace std;
+
+static bool UWithinBound(const VertexError& error, const VertexError& bound)
+{
+	return error.position <= bound.position && error.normal <= bound.normal && error.texCoord <= bound.texCoord;
+}
+
+GeometryRange GeometryPool::Add(const vector<float>& meshVertices, const vector<GLuint>& meshIndices)
+{
+	GeometryRange range;
+	range.firstIndex = (GLuint)indices.size();
+	range.baseVertex = (GLint)(vertices.size() / FLOATS_PER_VERTEX);
+	range.indexCount = (GLuint)meshIndices.size();
+	range.vertexCount = (GLuint)(meshVertices.size() / FLOATS_PER_VERTEX);
+
+	// indices stay mesh-local; baseVertex offsets them at draw time
+	vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+	indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+	largestMesh = max(largestMesh, range.vertexCount);
+
+	return range;
+}
+
+bool GeometryPool::Commit()
+{
+	// the packed data is only needed until it is uploaded; the floats stay for picking
+	vector<uint8_t> encoded;
+	decode = UComputeVertexDecode(format, vertices, FLOATS_PER_VERTEX);
+	UEncodeVertices(format, decode, vertices, FLOATS_PER_VERTEX, encoded);
+	error = UMeasureVertexError(format, decode, vertices, FLOATS_PER_VERTEX, encoded);
+	errorBound = UVertexErrorBound(format, decode, vertices, FLOATS_PER_VERTEX);
+	uploadedBytes = encoded.size();
+
+	if (vao == 0)
+	{
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		glGenBuffers(1, &ibo);
+	}
+
+	UStateCache().BindVertexArray(vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, encoded.size(), encoded.data(), GL_STATIC_DRAW);
+
+	// local indices only need 16 bits as long as no single mesh is larger than that
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	if (largestMesh <= 0xFFFF)
+	{
+		vector<GLushort> shortIndices(indices.begin(), indices.end());
+		indexType = GL_UNSIGNED_SHORT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		indexType = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	}
+
+	BindVertexLayout();
+	UStateCache().BindVertexArray(0);
+
+	return UWithinBound(error, errorBound);
+}
+
+void GeometryPool::BindVertexLayout() const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+
+	const VertexFormat& layout = UVertexFormat(format);
+	auto attribute = [&layout](GLuint location, const VertexAttribute& a) {
+		glVertexAttribPointer(location, a.size, a.type, a.normalized, layout.stride, (void*)(size_t)a.offset);
+		glEnableVertexAttribArray(location);
+	};
+
+	// location
+	attribute(0, layout.position);
+
+	// color / normal
+	attribute(1, layout.normal);
+
+	// texture
+	attribute(2, layout.texCoord);
+}
+
+void GeometryPool::ReportFormat(ostream& out) const
+{
+	const size_t count = vertices.size() / FLOATS_PER_VERTEX;
+	const VertexFormat& layout = UVertexFormat(format);
+	out << "INFO: Vertex format " << layout.name << ": " << layout.stride << " bytes per vertex (float: "
+		<< UVertexFormat(VERTEX_FORMAT_FLOAT).stride << "), " << count << " vertices in "
+		<< (uploadedBytes + 1023) / 1024 << " KiB" << endl;
+	out << "INFO: Vertex format " << layout.name << " max error: position " << setprecision(3) << error.position
+		<< " (bound " << errorBound.position << "), normal " << error.normal << " (bound " << errorBound.normal
+		<< "), uv " << error.texCoord << " (bound " << errorBound.texCoord << ")" << defaultfloat << endl;
+}
+
+bool GeometryPool::VerifyFormats(ostream& out) const
+{
+	const size_t count = vertices.size() / FLOATS_PER_VERTEX;
+	if (count == 0)
+	{
+		out << "ERROR: no vertices to check the vertex formats with" << endl;
+		return false;
+	}
+
+	bool inBounds = true;
+	for (int id = 0; id < VERTEX_FORMAT_COUNT; ++id)
+	{
+		const VertexFormatId candidate = (VertexFormatId)id;
+		vector<uint8_t> encoded;
+		const VertexDecode candidateDecode = UComputeVertexDecode(candidate, vertices, FLOATS_PER_VERTEX);
+		UEncodeVertices(candidate, candidateDecode, vertices, FLOATS_PER_VERTEX, encoded);
+		const VertexError measured = UMeasureVertexError(candidate, candidateDecode, vertices, FLOATS_PER_VERTEX, encoded);
+		const VertexError bound = UVertexErrorBound(candidate, candidateDecode, vertices, FLOATS_PER_VERTEX);
+
+		const bool passed = UWithinBound(measured, bound);
+		inBounds = inBounds && passed;
+		out << (passed ? "INFO" : "ERROR") << ": Vertex format " << UVertexFormat(candidate).name << " over " << count
+			<< " vertices: position " << setprecision(3) << measured.position << " (bound " << bound.position << "), normal "
+			<< measured.normal << " (bound " << bound.normal << "), uv " << measured.texCoord << " (bound " << bound.texCoord << ")"
+			<< defaultfloat << endl;
+	}
+	return inBounds;
+}
+
+bool GeometryPool::Raycast(GLuint firstIndex, GLuint indexCount, GLint baseVertex,
+	const glm::vec3& origin, const glm::vec3& direction, float& distance) const
+{
+	auto position = [this, baseVertex](GLuint index) {
+		const float* p = &vertices[(baseVertex + index) * FLOATS_PER_VERTEX];
+		return glm::vec3(p[0], p[1], p[2]);
+	};
+
+	bool hit = false;
+	for (GLuint i = firstIndex; i + 2 < firstIndex + indexCount; i += 3)
+	{
+		float t;
+		if (URayIntersectsTriangle(origin, direction, position(indices[i]), position(indices[i + 1]), position(indices[i + 2]), t) && t < distance)
+		{
+			distance = t;
+			hit = true;
+		}
+	}
+	return hit;
+}
+
+size_t GeometryPool::LiveGLObjects() const
+{
+	return (vao != 0) + (vbo != 0) + (ibo != 0);
+}
+
+void GeometryPool::Destroy()
+{
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ibo);
+	vao = vbo = ibo = 0;
+
+	vertices.clear();
+	indices.clear();
+	largestMesh = 0;
+	uploadedBytes = 0;
+}
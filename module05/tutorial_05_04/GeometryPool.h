@@ -0,0 +1,93 @@
+#pragma once
+
+// general includes
+#include <ostream>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+
+// where a mesh lives inside the shared vertex and index buffers
+struct GeometryRange
+{
+	GLuint firstIndex = 0;
+	GLint baseVertex = 0;
+	GLuint indexCount = 0;
+	GLuint vertexCount = 0;
+};
+
+// one vertex buffer, one index buffer and one VAO holding all static geometry,
+// so every static mesh can be drawn without rebinding anything
+class GeometryPool
+{
+public:
+	// interleaved position, normal/color and UV, as built by ShapeCreator
+	static constexpr GLuint FLOATS_PER_VERTEX = 9;
+
+	// appends welded vertices and their mesh-local indices; nothing reaches the GPU until Commit
+	GeometryRange Add(const std::vector<float>& vertices, const std::vector<GLuint>& indices);
+
+	// layout of the GPU copy; takes effect at the next Commit
+	void SetFormat(VertexFormatId id) { format = id; }
+
+	// (re)uploads everything added so far in the pool's format and sets up the shared VAO;
+	// returns false when the packed vertices strayed further from the floats than the format allows
+	bool Commit();
+
+	GLuint Vao() const { return vao; }
+
+	// points attributes 0-2 and the element buffer of the bound VAO at the pool,
+	// for VAOs that add attributes of their own (e.g. per-instance data)
+	void BindVertexLayout() const;
+
+	VertexFormatId Format() const { return format; }
+
+	// what the vertex shaders have to apply to the attributes, see FrameData
+	const VertexDecode& Decode() const { return decode; }
+
+	// bytes per vertex and the measured error of the last Commit
+	void ReportFormat(std::ostream& out) const;
+
+	// packs the vertices added so far in every format, decodes them the way the shaders do and
+	// compares them with the floats; one line per format, false when any exceeds its bound.
+	// Needs no GL context
+	bool VerifyFormats(std::ostream& out) const;
+
+	// GL_UNSIGNED_SHORT while every mesh has fewer than 65536 vertices
+	GLenum IndexType() const { return indexType; }
+	GLsizei IndexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
+	// byte offset of an index, for the draw calls that take a pointer
+	const void* IndexOffset(GLuint firstIndex) const { return (const void*)((size_t)firstIndex * IndexSize()); }
+
+	// nearest hit of a ray (in the mesh's own space) with the triangles of one mesh,
+	// from the CPU copy that the pool keeps after Commit
+	bool Raycast(GLuint firstIndex, GLuint indexCount, GLint baseVertex,
+		const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+
+	// VAO plus buffers owned by the pool; independent of the number of meshes
+	size_t LiveGLObjects() const;
+
+	void Destroy();
+
+private:
+	std::vector<float> vertices;
+	std::vector<GLuint> indices;
+	GLuint largestMesh = 0;
+
+	VertexFormatId format = VERTEX_FORMAT_FLOAT;
+	VertexDecode decode;
+	VertexError error;
+	VertexError errorBound;
+	size_t uploadedBytes = 0;
+
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	GLuint ibo = 0;
+	GLenum indexType = GL_UNSIGNED_SHORT;
+};
@@ -0,0 +1,115 @@
+#include <iostream>
+
+#include "HeadlessContext.h"
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+using namespace std;
+
+bool HeadlessContext::Create(int width, int height)
+{
+	start = chrono::steady_clock::now();
+
+#ifdef HEADLESS_EGL
+	// the surfaceless platform needs neither a display server nor a GPU
+	EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (eglDisplay == EGL_NO_DISPLAY)
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major = 0, minor = 0;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+	{
+		cout << "Failed to initialize EGL" << endl;
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint attributes[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 4,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	// no config and no surface: everything is drawn into the FBO below
+	EGLContext eglContext = eglCreateContext(eglDisplay, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+	{
+		cout << "Failed to create a headless OpenGL 4.4 context (EGL error 0x" << hex << eglGetError() << dec << ")" << endl;
+		eglTerminate(eglDisplay);
+		return false;
+	}
+	display = eglDisplay;
+	context = eglContext;
+
+	// GLEW: initialize; a GLX build of GLEW loads every GL function and only then
+	// complains that there is no X display, which does not matter here
+	glewExperimental = GL_TRUE;
+	GLenum GlewInitResult = glewInit();
+	if (GlewInitResult != GLEW_OK && GlewInitResult != GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		cerr << glewGetErrorString(GlewInitResult) << endl;
+		Destroy();
+		return false;
+	}
+
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cout << "Headless framebuffer is incomplete" << endl;
+		Destroy();
+		return false;
+	}
+	glViewport(0, 0, width, height);
+
+	return true;
+#else
+	(void)width;
+	(void)height;
+	cout << "Headless mode needs a build with HEADLESS_EGL (see CMakeLists.txt)" << endl;
+	return false;
+#endif
+}
+
+double HeadlessContext::Time() const
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void HeadlessContext::Destroy()
+{
+#ifdef HEADLESS_EGL
+	if (context)
+	{
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(1, &colorBuffer);
+		glDeleteRenderbuffers(1, &depthBuffer);
+		fbo = colorBuffer = depthBuffer = 0;
+
+		eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+		eglTerminate((EGLDisplay)display);
+	}
+#endif
+	display = nullptr;
+	context = nullptr;
+}
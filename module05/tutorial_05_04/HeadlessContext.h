@@ -0,0 +1,31 @@
+#pragma once
+
+// general includes
+#include <chrono>
+
+// glew includes
+#include <GL/glew.h>
+
+// an OpenGL 4.4 core context without a window (EGL surfaceless, e.g. Mesa llvmpipe)
+// rendering into a framebuffer object; only available when built with HEADLESS_EGL
+class HeadlessContext
+{
+public:
+	// creates the context, makes it current and binds a width x height FBO with depth
+	bool Create(int width, int height);
+
+	// seconds since Create, standing in for glfwGetTime
+	double Time() const;
+
+	void Destroy();
+
+private:
+	void* display = nullptr;
+	void* context = nullptr;
+
+	GLuint fbo = 0;
+	GLuint colorBuffer = 0;
+	GLuint depthBuffer = 0;
+
+	std::chrono::steady_clock::time_point start;
+};
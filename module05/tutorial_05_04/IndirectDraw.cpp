@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <numeric>
+
+#include "IndirectDraw.h"
+#include "StateCache.h"
+
+using namespace std;
+
+void IndirectDrawList::Create()
+{
+	glGenBuffers(1, &indirectBuffer);
+	glGenBuffers(1, &culledBuffer);
+	glGenBuffers(1, &drawBuffer);
+}
+
+void IndirectDrawList::Build(const RenderStore& store, const TextureArraySet* arrays)
+{
+	const size_t count = store.Size();
+
+	// draws sharing a texture (or a texture array) become one contiguous run of commands
+	vector<GLuint> slots(count, 0);
+	if (arrays)
+	{
+		for (size_t m = 0; m < count; ++m)
+			slots[m] = arrays->Slot(store.textureId[m]);
+	}
+	order.resize(count);
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&store, &slots, arrays](GLuint a, GLuint b) {
+		return arrays ? UTextureSlotArray(slots[a]) < UTextureSlotArray(slots[b]) : store.textureId[a] < store.textureId[b];
+	});
+
+	commands.resize(count);
+	draws.resize(count);
+	commandOfDraw.resize(count);
+	batchOfDraw.resize(count);
+	batches.clear();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const GLuint m = order[i];
+
+		DrawElementsIndirectCommand& command = commands[i];
+		command.count = store.indexCount[m];
+		command.instanceCount = 1;
+		command.firstIndex = store.firstIndex[m];
+		command.baseVertex = store.baseVertex[m];
+		// no instanced attributes use it, so it carries the index of the draw data
+		command.baseInstance = (GLuint)i;
+
+		DrawData& draw = draws[i];
+		draw.model = store.model[m];
+		draw.normalMatrix = glm::mat3x4(store.normalMatrix[m]);
+		draw.uvScale = store.uvScale[m];
+		draw.textureSlot = slots[m];
+		draw.padding = 0;
+
+		// texture 0 marks a batch that needs no bind; its draws share a texture array instead
+		const GLuint textureId = arrays ? 0 : store.textureId[m];
+		const GLuint textureArray = UTextureSlotArray(slots[m]);
+		if (batches.empty() || batches.back().textureId != textureId || batches.back().textureArray != textureArray)
+			batches.push_back({ textureId, textureArray, (GLuint)i, 0, (GLuint)i, 0 });
+		++batches.back().commandCount;
+		++batches.back().visibleCount;
+		commandOfDraw[m] = (GLuint)i;
+		batchOfDraw[m] = (GLuint)batches.size() - 1;
+	}
+	visibleCommands = commands;
+	visibleCount = count;
+	commandSource = indirectBuffer;
+	commandOffset = 0;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, draws.size() * sizeof(DrawData), draws.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void IndirectDrawList::Cull(const vector<uint8_t>& visibleDraws, const vector<GeometryRange>* ranges)
+{
+	// compact every batch in place of the full list, keeping the batch order
+	visibleCommands.clear();
+	for (Batch& batch : batches)
+	{
+		batch.firstVisible = (GLuint)visibleCommands.size();
+		for (GLuint i = batch.firstCommand; i < batch.firstCommand + batch.commandCount; ++i)
+		{
+			if (visibleDraws[order[i]])
+				visibleCommands.push_back(VisibleCommand(i, ranges));
+		}
+		batch.visibleCount = (GLuint)visibleCommands.size() - batch.firstVisible;
+	}
+	visibleCount = visibleCommands.size();
+	UploadVisible();
+}
+
+void IndirectDrawList::Cull(const vector<GLuint>& drawOrder, const vector<GeometryRange>* ranges)
+{
+	// count the draws of every batch to place the batches, then fill them in the given order
+	for (Batch& batch : batches)
+		batch.visibleCount = 0;
+	for (GLuint m : drawOrder)
+		++batches[batchOfDraw[m]].visibleCount;
+
+	GLuint first = 0;
+	for (Batch& batch : batches)
+	{
+		batch.firstVisible = first;
+		first += batch.visibleCount;
+		batch.visibleCount = 0;
+	}
+
+	visibleCommands.resize(drawOrder.size());
+	for (GLuint m : drawOrder)
+	{
+		Batch& batch = batches[batchOfDraw[m]];
+		visibleCommands[batch.firstVisible + batch.visibleCount++] = VisibleCommand(commandOfDraw[m], ranges);
+	}
+	visibleCount = visibleCommands.size();
+	UploadVisible();
+}
+
+DrawElementsIndirectCommand IndirectDrawList::VisibleCommand(GLuint command, const vector<GeometryRange>* ranges) const
+{
+	DrawElementsIndirectCommand visibleCommand = commands[command];
+	if (ranges)
+	{
+		const GeometryRange& range = (*ranges)[order[command]];
+		visibleCommand.count = range.indexCount;
+		visibleCommand.firstIndex = range.firstIndex;
+		visibleCommand.baseVertex = range.baseVertex;
+	}
+	return visibleCommand;
+}
+
+void IndirectDrawList::UploadVisible()
+{
+	const size_t bytes = visibleCommands.size() * sizeof(DrawElementsIndirectCommand);
+	if (ring && ring->Write(visibleCommands.data(), bytes, sizeof(GLuint), commandOffset))
+	{
+		commandSource = ring->Buffer();
+		return;
+	}
+
+	// the full list stays intact in indirectBuffer
+	commandSource = culledBuffer;
+	commandOffset = 0;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culledBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, bytes, visibleCommands.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectDrawList::Submit(const GeometryPool& pool, GLint textureArrayLoc) const
+{
+	if (visibleCount > 0)
+		Submit(pool, commandSource, commandOffset, true, textureArrayLoc);
+}
+
+void IndirectDrawList::SubmitAll(const GeometryPool& pool, GLint textureArrayLoc) const
+{
+	if (!commands.empty())
+		Submit(pool, indirectBuffer, 0, false, textureArrayLoc);
+}
+
+void IndirectDrawList::Submit(const GeometryPool& pool, GLuint buffer, GLintptr offset, bool visibleOnly, GLint textureArrayLoc) const
+{
+	UStateCache().BindVertexArray(pool.Vao());
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawBuffer);
+
+	for (const Batch& batch : batches)
+	{
+		const GLuint first = visibleOnly ? batch.firstVisible : batch.firstCommand;
+		const GLuint count = visibleOnly ? batch.visibleCount : batch.commandCount;
+		if (count == 0)
+			continue;
+
+		if (batch.textureId != 0)
+			UStateCache().BindTexture(0, GL_TEXTURE_2D, batch.textureId);
+		else if (textureArrayLoc >= 0)
+			glUniform1ui(textureArrayLoc, batch.textureArray);
+
+		glMultiDrawElementsIndirect(GL_TRIANGLES, pool.IndexType(),
+			(const void*)(offset + first * sizeof(DrawElementsIndirectCommand)), count, 0);
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectDrawList::Destroy()
+{
+	glDeleteBuffers(1, &indirectBuffer);
+	glDeleteBuffers(1, &culledBuffer);
+	glDeleteBuffers(1, &drawBuffer);
+	indirectBuffer = culledBuffer = drawBuffer = 0;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "GeometryPool.h"
+#include "MeshStore.h"
+#include "ShaderProgram.h"
+#include "TextureArrays.h"
+#include "UploadRing.h"
+
+// layout fixed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// CPU mirror of the std430 DrawData struct the vertex shader indexes with gl_BaseInstance
+struct DrawData
+{
+	glm::mat4 model;
+	glm::mat3x4 normalMatrix;	// std430 mat3: three columns padded to vec4
+	glm::vec2 uvScale;
+	GLuint textureSlot;
+	GLuint padding;
+};
+
+// the scene as indirect commands plus a per-draw storage buffer, submitted with
+// one glMultiDrawElementsIndirect per texture, or per texture array with arrays
+class IndirectDrawList
+{
+public:
+	void Create();
+
+	// regroups the draws by texture and uploads commands and per-draw data; with
+	// arrays every draw gets its texture slot instead and the draws are grouped by array
+	void Build(const RenderStore& store, const TextureArraySet* arrays = nullptr);
+
+	// keeps only the commands of visible draws (decided e.g. by a Frustum or a SceneBVH); one flag per
+	// store handle, and optionally the geometry each visible draw uses this frame (its level of detail).
+	// The per-draw data stays where it is, so only the command buffer is rewritten
+	void Cull(const std::vector<uint8_t>& visibleDraws, const std::vector<GeometryRange>* ranges = nullptr);
+
+	// keeps only the listed store handles, in the listed order inside their batch (e.g. sorted
+	// front to back by a RenderQueue); batches keep their own order
+	void Cull(const std::vector<GLuint>& drawOrder, const std::vector<GeometryRange>* ranges = nullptr);
+
+	// culled commands are streamed through the ring when one is set; the list's own
+	// command buffer is only rewritten when the ring has no room
+	void SetUploadRing(UploadRing* uploadRing) { ring = uploadRing; }
+
+	// binds the pool once and issues one multi-draw per batch that has anything left; with
+	// arrays, textureArrayLoc of the current program is set to the batch's array before each
+	void Submit(const GeometryPool& pool, GLint textureArrayLoc = -1) const;
+
+	// every draw at its finest level, whatever the last Cull kept (e.g. for a shadow map)
+	void SubmitAll(const GeometryPool& pool, GLint textureArrayLoc = -1) const;
+
+	size_t Batches() const { return batches.size(); }
+
+	// draws in the list, and how many survived the last Cull
+	size_t Size() const { return commands.size(); }
+	size_t Visible() const { return visibleCount; }
+
+	void Destroy();
+
+private:
+	struct Batch
+	{
+		GLuint textureId;
+		GLuint textureArray;
+		GLuint firstCommand;
+		GLuint commandCount;
+
+		// the same batch inside the culled command list
+		GLuint firstVisible;
+		GLuint visibleCount;
+	};
+
+	// command of a visible draw, at the geometry it uses this frame
+	DrawElementsIndirectCommand VisibleCommand(GLuint command, const std::vector<GeometryRange>* ranges) const;
+
+	// hands the visible commands to the ring, or to culledBuffer when it has no room
+	void UploadVisible();
+
+	// one multi-draw per batch from the given commands
+	void Submit(const GeometryPool& pool, GLuint buffer, GLintptr offset, bool visibleOnly, GLint textureArrayLoc) const;
+
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<DrawElementsIndirectCommand> visibleCommands;
+	size_t visibleCount = 0;
+	std::vector<DrawData> draws;
+	std::vector<Batch> batches;
+	std::vector<GLuint> order;
+
+	// command and batch of every store handle
+	std::vector<GLuint> commandOfDraw;
+	std::vector<GLuint> batchOfDraw;
+
+	GLuint indirectBuffer = 0;
+	GLuint culledBuffer = 0;	// culled commands when the ring has no room
+	GLuint drawBuffer = 0;
+
+	// where Submit reads the visible commands from this frame
+	UploadRing* ring = nullptr;
+	GLuint commandSource = 0;
+	GLintptr commandOffset = 0;
+};
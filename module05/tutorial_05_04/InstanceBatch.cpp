@@ -0,0 +1,216 @@
+#include <cstddef>
+
+#include "InstanceBatch.h"
+#include "StateCache.h"
+
+using namespace std;
+
+void InstanceBatch::Create(const GLMesh& mesh)
+{
+	base = mesh;
+}
+
+void InstanceBatch::CreateVertexArray(const GeometryPool& pool)
+{
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &instanceBuffer);
+
+	UStateCache().BindVertexArray(vao);
+	pool.BindVertexLayout();
+
+	// the instance buffer is attached per draw with glBindVertexBuffer, so the same VAO can read
+	// the batch's own buffer or wherever the ring put this frame's subset
+	glVertexBindingDivisor(INSTANCE_BUFFER_BINDING, 1);
+	auto attribute = [](GLuint location, GLint size, size_t offset) {
+		glVertexAttribFormat(location, size, GL_FLOAT, GL_FALSE, (GLuint)offset);
+		glVertexAttribBinding(location, INSTANCE_BUFFER_BINDING);
+		glEnableVertexAttribArray(location);
+	};
+
+	// model matrix, one column per attribute, advanced once per instance
+	for (GLuint column = 0; column < 4; ++column)
+		attribute(INSTANCE_ATTRIBUTE_BASE + column, 4, offsetof(InstanceData, model) + column * sizeof(glm::vec4));
+
+	// normal matrix, three vec3 columns stored with vec4 stride
+	for (GLuint column = 0; column < 3; ++column)
+		attribute(INSTANCE_ATTRIBUTE_BASE + 4 + column, 3, offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec4));
+
+	// texture scale
+	attribute(INSTANCE_ATTRIBUTE_BASE + 7, 2, offsetof(InstanceData, uvScale));
+
+	// texture slot, kept as an integer
+	glVertexAttribIFormat(INSTANCE_ATTRIBUTE_BASE + 8, 1, GL_UNSIGNED_INT, offsetof(InstanceData, textureSlot));
+	glVertexAttribBinding(INSTANCE_ATTRIBUTE_BASE + 8, INSTANCE_BUFFER_BINDING);
+	glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_BASE + 8);
+
+	UStateCache().BindVertexArray(0);
+}
+
+size_t InstanceBatch::Add(const glm::mat4& transform)
+{
+	InstanceData instance;
+	instance.model = transform * base.model;
+	instance.normalMatrix = glm::mat3x4(UNormalMatrix(instance.model));
+	instance.uvScale = base.gUVScale;
+	instance.textureSlot = textureSlot;
+	instance.padding = 0;
+
+	const BoundingBox box = UTransformBox(base.localBox, instance.model);
+	bounds = instances.empty() ? box : UMergeBoxes(bounds, box);
+
+	instances.push_back(instance);
+	isMoved.push_back(0);
+	dirty = gatherDirty = true;
+	++version;
+	return instances.size() - 1;
+}
+
+void InstanceBatch::SetTransform(size_t instance, const glm::mat4& transform)
+{
+	instances[instance].model = transform * base.model;
+	instances[instance].normalMatrix = glm::mat3x4(UNormalMatrix(instances[instance].model));
+	dirty = gatherDirty = true;
+	++version;
+	if (!isMoved[instance])
+	{
+		isMoved[instance] = 1;
+		moved.push_back(instance);
+	}
+
+	// moving an instance can shrink the batch as well as grow it
+	bounds = UTransformBox(base.localBox, instances[0].model);
+	for (const auto& other : instances)
+		bounds = UMergeBoxes(bounds, UTransformBox(base.localBox, other.model));
+}
+
+void InstanceBatch::ClearMoved()
+{
+	for (size_t instance : moved)
+		isMoved[instance] = 0;
+	moved.clear();
+}
+
+void InstanceBatch::SetTextureSlot(GLuint slot)
+{
+	textureSlot = slot;
+	for (auto& instance : instances)
+		instance.textureSlot = slot;
+	dirty = gatherDirty = true;
+}
+
+void InstanceBatch::Draw(const GeometryPool& pool, bool bindTexture, const vector<GLuint>* visible, const vector<uint8_t>* levels)
+{
+	if (instances.empty() || (visible && visible->empty()))
+		return;
+
+	if (vao == 0)
+		CreateVertexArray(pool);
+
+	GLuint source = instanceBuffer;
+	GLintptr offset = 0;
+	const bool subset = visible && (visible->size() < instances.size() || levels);
+	if (subset)
+	{
+		// the visible instances packed at the front, grouped by level; skipped while nothing changed
+		if (gatherDirty || *visible != uploadedVisible || (levels && *levels != uploadedLevels))
+		{
+			levelCounts.assign(base.lods.size(), 0);
+			for (size_t i = 0; i < visible->size(); ++i)
+				++levelCounts[levels ? (*levels)[i] : 0];
+
+			vector<GLuint> next(levelCounts.size(), 0);
+			for (size_t level = 1; level < levelCounts.size(); ++level)
+				next[level] = next[level - 1] + levelCounts[level - 1];
+
+			gathered.resize(visible->size());
+			for (size_t i = 0; i < visible->size(); ++i)
+				gathered[next[levels ? (*levels)[i] : 0]++] = instances[(*visible)[i]];
+
+			uploadedVisible = *visible;
+			if (levels)
+				uploadedLevels = *levels;
+			uploadedGathered = false;
+			gatherDirty = false;
+		}
+
+		// a ring copy only lives for its frame, so the subset is written again every frame
+		const size_t bytes = gathered.size() * sizeof(InstanceData);
+		if (ring && ring->Write(gathered.data(), bytes, sizeof(glm::vec4), offset))
+			source = ring->Buffer();
+		else
+		{
+			if (gathered.size() > subsetCapacity)
+			{
+				if (subsetBuffer == 0)
+					glGenBuffers(1, &subsetBuffer);
+				glBindBuffer(GL_ARRAY_BUFFER, subsetBuffer);
+				subsetCapacity = instances.size();
+				glBufferData(GL_ARRAY_BUFFER, subsetCapacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+				uploadedGathered = false;
+			}
+			if (!uploadedGathered)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, subsetBuffer);
+				glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, gathered.data());
+				uploadedGathered = true;
+			}
+			source = subsetBuffer;
+		}
+	}
+	else
+	{
+		// the full set stays resident, so it is only written when an instance changed
+		if (instances.size() > instanceCapacity)
+		{
+			// grow the buffer; only happens while instances are being added
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+			instanceCapacity = instances.size();
+			glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+			dirty = true;
+		}
+		if (dirty)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+			dirty = false;
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	UStateCache().BindVertexArray(vao);
+	glBindVertexBuffer(INSTANCE_BUFFER_BINDING, source, offset, sizeof(InstanceData));
+
+	if (bindTexture)
+		UStateCache().BindTexture(0, GL_TEXTURE_2D, textureId);
+
+	// one draw per level, each starting at its run of the instance buffer; everything is level 0
+	const size_t drawLevels = subset ? levelCounts.size() : 1;
+	GLuint firstInstance = 0;
+	for (size_t level = 0; level < drawLevels; ++level)
+	{
+		const GLuint count = subset ? levelCounts[level] : (GLuint)instances.size();
+		if (count == 0)
+			continue;
+
+		const GeometryRange& range = base.lods[level].range;
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, pool.IndexType(),
+			pool.IndexOffset(range.firstIndex), count, range.baseVertex, firstInstance);
+		firstInstance += count;
+	}
+}
+
+void InstanceBatch::Destroy()
+{
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteBuffers(1, &subsetBuffer);
+	vao = instanceBuffer = subsetBuffer = 0;
+	instanceCapacity = subsetCapacity = 0;
+	instances.clear();
+	moved.clear();
+	isMoved.clear();
+	uploadedVisible.clear();
+	uploadedLevels.clear();
+	levelCounts.clear();
+	uploadedGathered = false;
+}
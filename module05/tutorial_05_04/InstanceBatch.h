@@ -0,0 +1,112 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "GeometryPool.h"
+#include "IndirectDraw.h"
+#include "Mesh.h"
+#include "Transform.h"
+#include "UploadRing.h"
+
+// per-instance vertex attributes; same layout as the per-draw DrawData
+typedef DrawData InstanceData;
+
+// first attribute location used by the per-instance data (model takes 3-6, normal matrix 7-9,
+// uv scale 10, texture slot 11)
+constexpr GLuint INSTANCE_ATTRIBUTE_BASE = 3;
+
+// vertex buffer binding the per-instance attributes read from, after the pool's 0-2
+constexpr GLuint INSTANCE_BUFFER_BINDING = 3;
+
+// one shape built once by ShapeCreator and drawn N times with a single instanced draw
+class InstanceBatch
+{
+public:
+	// base is a mesh that has already been added to the pool; its model matrix
+	// is applied before every instance transform
+	void Create(const GLMesh& base);
+
+	// appends an instance placed by transform (on top of the base model matrix)
+	size_t Add(const glm::mat4& transform);
+	void SetTransform(size_t instance, const glm::mat4& transform);
+
+	// texture shared by the instances, bound by Draw unless they use texture arrays
+	void SetTexture(GLuint id) { textureId = id; }
+	GLuint Texture() const { return textureId; }
+
+	// visible subsets are streamed through the ring every frame when one is set, or kept in a
+	// buffer of their own when the ring has no room; the instance buffer always holds the full set
+	void SetUploadRing(UploadRing* uploadRing) { ring = uploadRing; }
+
+	// gives every instance the same texture array slot, so one draw of the batch samples one array
+	void SetTextureSlot(GLuint slot);
+	GLuint TextureSlot() const { return textureSlot; }
+	const GLMesh& Base() const { return base; }
+
+	// valid once the batch has been drawn
+	GLuint Vao() const { return vao; }
+	size_t Size() const { return instances.size(); }
+
+	// bumped whenever an instance is added or moved
+	unsigned Version() const { return version; }
+
+	// instances moved by SetTransform since the last ClearMoved, each listed once
+	const std::vector<size_t>& Moved() const { return moved; }
+	void ClearMoved();
+
+	// world box around every instance, for culling the batch as a whole
+	const BoundingBox& Bounds() const { return bounds; }
+
+	// one instance's final model matrix and world box, for a SceneBVH and picking
+	const glm::mat4& Model(size_t instance) const { return instances[instance].model; }
+	BoundingBox InstanceBounds(size_t instance) const { return UTransformBox(base.localBox, instances[instance].model); }
+
+	// one glDrawElementsInstancedBaseVertex for every instance, or only for the listed ones, with
+	// one draw per level of detail when levels (parallel to visible) are given; uploads first if
+	// anything changed. Drawing everything and drawing a subset in the same frame (shadow and main
+	// pass) upload nothing twice
+	void Draw(const GeometryPool& pool, bool bindTexture = true, const std::vector<GLuint>* visible = nullptr,
+		const std::vector<uint8_t>* levels = nullptr);
+
+	void Destroy();
+
+private:
+	// VAO reading the pool's vertices plus the instance buffer; needs a committed pool
+	void CreateVertexArray(const GeometryPool& pool);
+
+	GLMesh base;
+	GLuint textureId = 0;
+	GLuint textureSlot = 0;
+
+	std::vector<InstanceData> instances;
+	bool dirty = false;			// the instance buffer is behind instances
+	bool gatherDirty = false;	// gathered is behind instances
+	unsigned version = 0;
+	std::vector<size_t> moved;
+	std::vector<uint8_t> isMoved;
+
+	// the last visible subset, packed by level, and the buffer it falls back to without ring room
+	std::vector<GLuint> uploadedVisible;
+	std::vector<uint8_t> uploadedLevels;
+	std::vector<InstanceData> gathered;
+	bool uploadedGathered = false;
+	UploadRing* ring = nullptr;
+
+	// instances per level in the uploaded subset, which is sorted by level
+	std::vector<GLuint> levelCounts;
+	BoundingBox bounds;
+
+	GLuint vao = 0;
+	GLuint instanceBuffer = 0;
+	size_t instanceCapacity = 0;
+	GLuint subsetBuffer = 0;
+	size_t subsetCapacity = 0;
+};
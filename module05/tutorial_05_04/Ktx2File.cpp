@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Ktx2File.h"
+
+using namespace std;
+
+// file layout: identifier, header, index, level index, data format descriptor,
+// key/value data, then the levels smallest first
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const size_t KTX2_HEADER_BYTES = 12 + 9 * 4;
+static const size_t KTX2_INDEX_BYTES = 4 * 4 + 2 * 8;
+static const size_t KTX2_LEVEL_BYTES = 3 * 8;
+
+// data format descriptor values (Khronos Data Format Specification 1.3)
+static const uint32_t KHR_DF_MODEL_BC1A = 128;
+static const uint32_t KHR_DF_MODEL_BC3 = 130;
+static const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+static const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+static const uint32_t KHR_DF_CHANNEL_COLOR = 0;
+static const uint32_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+
+uint32_t UKtx2BlockBytes(uint32_t vkFormat)
+{
+	switch (vkFormat)
+	{
+	case KTX2_FORMAT_BC1_RGB_UNORM:
+		return 8;
+	case KTX2_FORMAT_BC3_UNORM:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+// bytes of one mip level of a width x height image
+static size_t ULevelBytes(uint32_t blockBytes, uint32_t width, uint32_t height, size_t level)
+{
+	const size_t levelWidth = max(1u, width >> level);
+	const size_t levelHeight = max(1u, height >> level);
+	return ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockBytes;
+}
+
+static uint32_t UReadU32(const unsigned char* bytes)
+{
+	uint32_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+static uint64_t UReadU64(const unsigned char* bytes)
+{
+	uint64_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+bool MappedFile::Open(const string& filename)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE fileHandleW = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandleW == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandleW, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(fileHandleW);
+		return false;
+	}
+	HANDLE mappingHandleW = CreateFileMappingA(fileHandleW, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void* view = mappingHandleW ? MapViewOfFile(mappingHandleW, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view)
+	{
+		if (mappingHandleW)
+			CloseHandle(mappingHandleW);
+		CloseHandle(fileHandleW);
+		return false;
+	}
+	fileHandle = fileHandleW;
+	mappingHandle = mappingHandleW;
+	data = (const unsigned char*)view;
+	size = (size_t)fileSize.QuadPart;
+#else
+	const int descriptor = open(filename.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return false;
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || status.st_size == 0)
+	{
+		close(descriptor);
+		return false;
+	}
+	void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	// the mapping keeps the file alive on its own
+	close(descriptor);
+	if (view == MAP_FAILED)
+		return false;
+	data = (const unsigned char*)view;
+	size = (size_t)status.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (!data)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mappingHandle);
+	CloseHandle((HANDLE)fileHandle);
+	fileHandle = mappingHandle = nullptr;
+#else
+	munmap((void*)data, size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+bool Ktx2Texture::Open(const string& filename)
+{
+	Close();
+	if (!file.Open(filename))
+		return false;
+
+	const unsigned char* bytes = file.Data();
+	const size_t fileSize = file.Size();
+	if (fileSize < KTX2_HEADER_BYTES + KTX2_INDEX_BYTES || memcmp(bytes, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	// vkFormat, typeSize, pixelWidth, pixelHeight, pixelDepth, layerCount, faceCount, levelCount, supercompressionScheme
+	uint32_t header[9];
+	for (int i = 0; i < 9; ++i)
+		header[i] = UReadU32(bytes + 12 + 4 * i);
+	vkFormat = header[0];
+	width = header[2];
+	height = header[3];
+	const uint32_t blockBytes = UKtx2BlockBytes(vkFormat);
+	const uint32_t levelCount = header[7];
+
+	const size_t levelIndex = KTX2_HEADER_BYTES + KTX2_INDEX_BYTES;
+	if (blockBytes == 0 || header[1] != 1 || width == 0 || height == 0 || header[4] != 0 || header[5] > 1 || header[6] != 1
+		|| levelCount == 0 || header[8] != 0 || levelIndex + (size_t)levelCount * KTX2_LEVEL_BYTES > fileSize)
+	{
+		Close();
+		return false;
+	}
+
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		const unsigned char* entry = bytes + levelIndex + level * KTX2_LEVEL_BYTES;
+		const uint64_t offset = UReadU64(entry);
+		const uint64_t length = UReadU64(entry + 8);
+		if (offset > fileSize || length > fileSize - offset || length != ULevelBytes(blockBytes, width, height, level))
+		{
+			Close();
+			return false;
+		}
+
+		Level view;
+		view.data = bytes + offset;
+		view.size = (size_t)length;
+		levels.push_back(view);
+	}
+	return true;
+}
+
+void Ktx2Texture::Close()
+{
+	file.Close();
+	vkFormat = width = height = 0;
+	levels.clear();
+}
+
+static void UAppendU32(vector<unsigned char>& out, uint32_t value)
+{
+	const unsigned char* bytes = (const unsigned char*)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+static void UAppendU64(vector<unsigned char>& out, uint64_t value)
+{
+	const unsigned char* bytes = (const unsigned char*)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+static void UPadTo(vector<unsigned char>& out, size_t alignment)
+{
+	while (out.size() % alignment)
+		out.push_back(0);
+}
+
+// basic descriptor block with one 64-bit sample per plane of the block
+static vector<unsigned char> UDataFormatDescriptor(uint32_t vkFormat)
+{
+	const bool alpha = vkFormat == KTX2_FORMAT_BC3_UNORM;
+	const uint32_t samples = alpha ? 2 : 1;
+	const uint32_t blockSize = 24 + 16 * samples;
+
+	vector<unsigned char> dfd;
+	UAppendU32(dfd, 4 + blockSize);
+	UAppendU32(dfd, 0);	// Khronos vendor, basic descriptor type
+	UAppendU32(dfd, 2 | (blockSize << 16));
+	UAppendU32(dfd, (alpha ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A) | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+	UAppendU32(dfd, 3 | (3 << 8));	// 4x4 texel blocks
+	UAppendU32(dfd, UKtx2BlockBytes(vkFormat));
+	UAppendU32(dfd, 0);
+
+	// BC3 keeps its alpha in the first 64 bits and the BC1 colour in the second
+	uint32_t bitOffset = 0;
+	for (uint32_t sample = 0; sample < samples; ++sample)
+	{
+		const uint32_t channel = alpha && sample == 0 ? KHR_DF_CHANNEL_BC3_ALPHA : KHR_DF_CHANNEL_COLOR;
+		UAppendU32(dfd, bitOffset | (63 << 16) | (channel << 24));
+		UAppendU32(dfd, 0);
+		UAppendU32(dfd, 0);
+		UAppendU32(dfd, 0xFFFFFFFF);
+		bitOffset += 64;
+	}
+	return dfd;
+}
+
+bool UWriteKtx2(const string& filename, uint32_t vkFormat, uint32_t width, uint32_t height,
+	const vector<vector<unsigned char>>& levels, const string& writer)
+{
+	const uint32_t blockBytes = UKtx2BlockBytes(vkFormat);
+	if (blockBytes == 0 || levels.empty())
+		return false;
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		if (levels[level].size() != ULevelBytes(blockBytes, width, height, level))
+			return false;
+	}
+
+	const vector<unsigned char> dfd = UDataFormatDescriptor(vkFormat);
+
+	// keys in byte order; the rows were flipped for OpenGL, so the first one is the bottom
+	vector<unsigned char> kvd;
+	const pair<string, string> keyValues[] = { { "KTXorientation", "ru" }, { "KTXwriter", writer } };
+	for (const auto& keyValue : keyValues)
+	{
+		UAppendU32(kvd, (uint32_t)(keyValue.first.size() + 1 + keyValue.second.size() + 1));
+		kvd.insert(kvd.end(), keyValue.first.begin(), keyValue.first.end());
+		kvd.push_back(0);
+		kvd.insert(kvd.end(), keyValue.second.begin(), keyValue.second.end());
+		kvd.push_back(0);
+		UPadTo(kvd, 4);
+	}
+
+	const size_t dfdOffset = KTX2_HEADER_BYTES + KTX2_INDEX_BYTES + levels.size() * KTX2_LEVEL_BYTES;
+	const size_t kvdOffset = dfdOffset + dfd.size();
+
+	// every level starts on a whole block, smallest first
+	vector<uint64_t> offsets(levels.size());
+	size_t end = kvdOffset + kvd.size();
+	for (size_t level = levels.size(); level-- > 0;)
+	{
+		end = (end + blockBytes - 1) / blockBytes * blockBytes;
+		offsets[level] = end;
+		end += levels[level].size();
+	}
+
+	vector<unsigned char> out(KTX2_IDENTIFIER, KTX2_IDENTIFIER + sizeof(KTX2_IDENTIFIER));
+	const uint32_t header[9] = { vkFormat, 1, width, height, 0, 0, 1, (uint32_t)levels.size(), 0 };
+	for (uint32_t value : header)
+		UAppendU32(out, value);
+	UAppendU32(out, (uint32_t)dfdOffset);
+	UAppendU32(out, (uint32_t)dfd.size());
+	UAppendU32(out, (uint32_t)kvdOffset);
+	UAppendU32(out, (uint32_t)kvd.size());
+	UAppendU64(out, 0);
+	UAppendU64(out, 0);
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		UAppendU64(out, offsets[level]);
+		UAppendU64(out, levels[level].size());
+		UAppendU64(out, levels[level].size());
+	}
+	out.insert(out.end(), dfd.begin(), dfd.end());
+	out.insert(out.end(), kvd.begin(), kvd.end());
+	for (size_t level = levels.size(); level-- > 0;)
+	{
+		UPadTo(out, blockBytes);
+		out.insert(out.end(), levels[level].begin(), levels[level].end());
+	}
+
+	ofstream file(filename, ios::binary | ios::trunc);
+	if (!file)
+		return false;
+	file.write((const char*)out.data(), out.size());
+	return (bool)file;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// general includes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// the block-compressed Vulkan formats the texture baker writes: BC1 for opaque
+// images, BC3 when the image has alpha (both linear, like the RGB8/RGBA8 uploads)
+constexpr uint32_t KTX2_FORMAT_BC1_RGB_UNORM = 131;
+constexpr uint32_t KTX2_FORMAT_BC3_UNORM = 137;
+
+// bytes of one 4x4 block of a format above, 0 for any other
+uint32_t UKtx2BlockBytes(uint32_t vkFormat);
+
+// a whole file mapped read-only, so its bytes go from the page cache to the
+// driver without another copy
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { Close(); }
+
+	bool Open(const std::string& filename);
+	void Close();
+
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
+
+// a KTX2 file as the baker writes it: one 2D image, one face, no supercompression,
+// its mip levels pointing straight into the mapping
+class Ktx2Texture
+{
+public:
+	struct Level
+	{
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+	};
+
+	// maps filename and checks the header and level index; false (and nothing
+	// mapped) for a missing file or anything this loader does not handle
+	bool Open(const std::string& filename);
+	void Close();
+
+	uint32_t Format() const { return vkFormat; }
+	uint32_t Width() const { return width; }
+	uint32_t Height() const { return height; }
+
+	// level 0 is the full size image
+	const std::vector<Level>& Levels() const { return levels; }
+
+	const unsigned char* FileData() const { return file.Data(); }
+	size_t FileSize() const { return file.Size(); }
+
+private:
+	MappedFile file;
+	uint32_t vkFormat = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<Level> levels;
+};
+
+// writes levels (level 0 the full size, each already block compressed in vkFormat)
+// as a KTX2 file with its data format descriptor; writer names the tool in the
+// key/value data
+bool UWriteKtx2(const std::string& filename, uint32_t vkFormat, uint32_t width, uint32_t height,
+	const std::vector<std::vector<unsigned char>>& levels, const std::string& writer);
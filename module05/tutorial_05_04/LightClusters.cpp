@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "LightClusters.h"
+#include "ShaderProgram.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLUSTER_SSE 1
+#endif
+
+using namespace std;
+
+void LightClusters::Create()
+{
+	glGenBuffers(1, &lightBuffer);
+	glGenBuffers(1, &clusterBuffer);
+	glGenBuffers(1, &indexBuffer);
+}
+
+void LightClusters::SetProjection(const glm::mat4& matrix, float nearDistance, float farDistance)
+{
+	if (matrix == projection && nearDistance == nearPlane && farDistance == farPlane)
+		return;
+	projection = matrix;
+	nearPlane = nearDistance;
+	farPlane = farDistance;
+
+	for (auto* v : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+		v->resize(CLUSTER_COUNT);
+
+	// each tile corner is a line through the frustum, perspective or not; the cluster box holds
+	// where the corner lines cross the slice's near and far depth
+	const glm::mat4 inverse = glm::inverse(projection);
+	auto unproject = [&inverse](float x, float y, float z) {
+		const glm::vec4 p = inverse * glm::vec4(x, y, z, 1.0f);
+		return glm::vec3(p) / p.w;
+	};
+
+	for (GLuint y = 0; y < CLUSTERS_Y; ++y)
+	{
+		for (GLuint x = 0; x < CLUSTERS_X; ++x)
+		{
+			glm::vec3 lineStart[4], lineEnd[4];
+			for (int corner = 0; corner < 4; ++corner)
+			{
+				const float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / CLUSTERS_X;
+				const float ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / CLUSTERS_Y;
+				lineStart[corner] = unproject(ndcX, ndcY, -1.0f);
+				lineEnd[corner] = unproject(ndcX, ndcY, 1.0f);
+			}
+
+			for (GLuint z = 0; z < CLUSTERS_Z; ++z)
+			{
+				const float depths[2] = {
+					nearPlane * pow(farPlane / nearPlane, (float)z / CLUSTERS_Z),
+					nearPlane * pow(farPlane / nearPlane, (float)(z + 1) / CLUSTERS_Z)
+				};
+
+				glm::vec3 lowest(INFINITY), highest(-INFINITY);
+				for (int corner = 0; corner < 4; ++corner)
+				{
+					for (float depth : depths)
+					{
+						const glm::vec3 along = lineEnd[corner] - lineStart[corner];
+						const glm::vec3 p = lineStart[corner] + along * ((-depth - lineStart[corner].z) / along.z);
+						lowest = glm::min(lowest, p);
+						highest = glm::max(highest, p);
+					}
+				}
+
+				const GLuint cluster = (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+				minX[cluster] = lowest.x;
+				minY[cluster] = lowest.y;
+				minZ[cluster] = lowest.z;
+				maxX[cluster] = highest.x;
+				maxY[cluster] = highest.y;
+				maxZ[cluster] = highest.z;
+			}
+		}
+	}
+}
+
+glm::vec4 LightClusters::Scale(int width, int height) const
+{
+	const float sliceScale = CLUSTERS_Z / log(farPlane / nearPlane);
+	return glm::vec4((float)CLUSTERS_X / width, (float)CLUSTERS_Y / height, sliceScale, -log(nearPlane) * sliceScale);
+}
+
+void LightClusters::Assign(const vector<PointLight>& lights, const glm::mat4& view)
+{
+	lightCount = (GLuint)lights.size();
+	if (lights.empty())
+		return;
+
+	const auto start = chrono::steady_clock::now();
+
+	const glm::vec4 scale = Scale(1, 1);
+	auto sliceOf = [&](float depth) {
+		return (GLuint)min(max((int)floor(log(depth) * scale.z + scale.w), 0), (int)CLUSTERS_Z - 1);
+	};
+
+	counts.assign(CLUSTER_COUNT, 0);
+	pairCluster.clear();
+	pairLight.clear();
+	auto hit = [&](GLuint cluster, GLuint light) {
+		pairCluster.push_back(cluster);
+		pairLight.push_back(light);
+		++counts[cluster];
+	};
+
+	for (GLuint light = 0; light < lightCount; ++light)
+	{
+		const glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(lights[light].positionRadius), 1.0f));
+		const float radius = lights[light].positionRadius.w;
+		const float depth = -center.z;
+		if (depth + radius < nearPlane || depth - radius > farPlane)
+			continue;
+
+		// only the slices the sphere reaches, then every tile of them
+		const GLuint firstSlice = sliceOf(max(depth - radius, nearPlane));
+		const GLuint lastSlice = sliceOf(min(depth + radius, farPlane));
+		for (GLuint slice = firstSlice; slice <= lastSlice; ++slice)
+		{
+			const GLuint first = slice * CLUSTERS_X * CLUSTERS_Y;
+			const GLuint end = first + CLUSTERS_X * CLUSTERS_Y;
+			GLuint cluster = first;
+
+#ifdef CLUSTER_SSE
+			// squared distance from the sphere center to each box, four boxes at a time
+			const __m128 cx = _mm_set1_ps(center.x);
+			const __m128 cy = _mm_set1_ps(center.y);
+			const __m128 cz = _mm_set1_ps(center.z);
+			const __m128 radiusSquared = _mm_set1_ps(radius * radius);
+			const __m128 zero = _mm_setzero_ps();
+			for (; cluster + 4 <= end; cluster += 4)
+			{
+				const __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[cluster]), cx), zero), _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&maxX[cluster])), zero));
+				const __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[cluster]), cy), zero), _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&maxY[cluster])), zero));
+				const __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[cluster]), cz), zero), _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&maxZ[cluster])), zero));
+				const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+				const int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared));
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					if ((mask >> lane) & 1)
+						hit(cluster + lane, light);
+				}
+			}
+#endif
+
+			for (; cluster < end; ++cluster)
+			{
+				const glm::vec3 nearest = glm::clamp(center, glm::vec3(minX[cluster], minY[cluster], minZ[cluster]),
+					glm::vec3(maxX[cluster], maxY[cluster], maxZ[cluster]));
+				const glm::vec3 offset = nearest - center;
+				if (glm::dot(offset, offset) <= radius * radius)
+					hit(cluster, light);
+			}
+		}
+	}
+
+	// counting sort of the hits by cluster; each list keeps the lights in order
+	clusters.resize(CLUSTER_COUNT);
+	GLuint offset = 0;
+	for (GLuint cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+	{
+		clusters[cluster] = glm::uvec2(offset, counts[cluster]);
+		offset += counts[cluster];
+		occupied += counts[cluster] > 0;
+		mostInCluster = max(mostInCluster, (size_t)counts[cluster]);
+	}
+	indices.resize(max<size_t>(pairLight.size(), 1));
+	for (size_t i = 0; i < pairLight.size(); ++i)
+		indices[clusters[pairCluster[i]].x + --counts[pairCluster[i]]] = pairLight[i];
+
+	Upload(LIGHT_DATA_BINDING, lightBuffer, lights.data(), lights.size() * sizeof(PointLight));
+	Upload(CLUSTER_DATA_BINDING, clusterBuffer, clusters.data(), clusters.size() * sizeof(glm::uvec2));
+	Upload(LIGHT_INDEX_BINDING, indexBuffer, indices.data(), indices.size() * sizeof(GLuint));
+
+	++frames;
+	assigned += pairLight.size();
+	milliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void LightClusters::Upload(GLuint binding, GLuint buffer, const void* data, size_t size)
+{
+	GLintptr offset;
+	if (ring && ring->Write(data, size, ring->StorageAlignment(), offset))
+	{
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, ring->Buffer(), offset, size);
+		return;
+	}
+
+	// a new store each frame, so the GPU can keep reading the old one
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
+void LightClusters::Report(ostream& out) const
+{
+	if (frames == 0)
+		return;
+
+	out << "INFO: Clustered lighting: " << lightCount << " lights in " << CLUSTERS_X << "x" << CLUSTERS_Y << "x" << CLUSTERS_Z
+		<< " clusters, " << assigned / frames << " cluster entries per frame, "
+		<< (occupied > 0 ? (double)assigned / occupied : 0.0) << " lights per occupied cluster (at most " << mostInCluster
+		<< "), assigned in " << milliseconds / frames << " ms per frame" << endl;
+}
+
+void LightClusters::Destroy()
+{
+	glDeleteBuffers(1, &lightBuffer);
+	glDeleteBuffers(1, &clusterBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	lightBuffer = clusterBuffer = indexBuffer = 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "UploadRing.h"
+
+// CPU mirror of the std430 PointLight struct the fragment shader reads
+struct PointLight
+{
+	glm::vec4 positionRadius;	// world position, and the distance where the light fades out
+	glm::vec4 color;
+};
+
+// splits the view frustum into a grid of screen tiles times exponential depth slices and lists
+// the point lights that reach each cell, so a fragment only shades with the lights of its own
+// cluster. The lists go to the GPU as three storage buffers: the lights, an (offset, count)
+// pair per cluster and the light indices those pairs point into
+class LightClusters
+{
+public:
+	static constexpr GLuint CLUSTERS_X = 16;
+	static constexpr GLuint CLUSTERS_Y = 12;
+	static constexpr GLuint CLUSTERS_Z = 24;
+	static constexpr GLuint CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+
+	void Create();
+
+	// the three buffers are streamed through the ring when one is set
+	void SetUploadRing(UploadRing* uploadRing) { ring = uploadRing; }
+
+	// rebuilds the view space box of every cluster; cheap to call with an unchanged projection
+	void SetProjection(const glm::mat4& projection, float nearPlane, float farPlane);
+
+	// tests every light against the cluster boxes it can reach (four boxes at a time with SSE
+	// where available), uploads the result and binds it for the frame
+	void Assign(const std::vector<PointLight>& lights, const glm::mat4& view);
+
+	// what the shaders need to find a fragment's cluster: tiles per pixel in xy, and the scale
+	// and bias that turn log(view depth) into a slice
+	glm::vec4 Scale(int width, int height) const;
+
+	// clusters per axis, and the number of lights in w
+	glm::uvec4 Size() const { return glm::uvec4(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, lightCount); }
+
+	void Report(std::ostream& out) const;
+
+	void Destroy();
+
+private:
+	// binds data at binding, from the ring or from buffer
+	void Upload(GLuint binding, GLuint buffer, const void* data, size_t size);
+
+	// structure of arrays, so four boxes load as one register per plane
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+	glm::mat4 projection = glm::mat4(0.0f);
+	float nearPlane = 0.1f;
+	float farPlane = 100.0f;
+
+	std::vector<GLuint> counts;
+	std::vector<glm::uvec2> clusters;		// offset and count into indices
+	std::vector<GLuint> indices;
+	std::vector<GLuint> pairCluster;		// (cluster, light) hits in light order
+	std::vector<GLuint> pairLight;
+	GLuint lightCount = 0;
+
+	UploadRing* ring = nullptr;
+	GLuint lightBuffer = 0;
+	GLuint clusterBuffer = 0;
+	GLuint indexBuffer = 0;
+
+	// totals since startup
+	size_t frames = 0;
+	size_t assigned = 0;
+	size_t occupied = 0;
+	size_t mostInCluster = 0;
+	double milliseconds = 0.0;
+};
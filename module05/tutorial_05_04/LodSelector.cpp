@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cmath>
+
+#include "LodSelector.h"
+
+using namespace std;
+
+uint32_t LodSelector::AddChain(const vector<LodLevel>& levels)
+{
+	chains.push_back(levels);
+	return (uint32_t)chains.size() - 1;
+}
+
+void LodSelector::SetObject(uint32_t object, uint32_t chain, const BoundingSphere& sphere, float radius)
+{
+	if (object >= chainOf.size())
+	{
+		chainOf.resize(object + 1, 0);
+		spheres.resize(object + 1);
+		radii.resize(object + 1, 0.0f);
+		current.resize(object + 1, 0);
+	}
+
+	// a new chain may be shorter than the level the object was at
+	if (chainOf[object] != chain)
+		current[object] = 0;
+
+	chainOf[object] = chain;
+	spheres[object] = glm::vec4(sphere.center, sphere.radius);
+	radii[object] = radius;
+}
+
+void LodSelector::SetView(const glm::vec3& eyePosition, float scale, bool isOrthographic)
+{
+	eye = eyePosition;
+	pixelScale = scale;
+	orthographic = isOrthographic;
+}
+
+size_t LodSelector::Select(const vector<uint32_t>& objects, vector<uint8_t>& levels)
+{
+	levels.resize(objects.size());
+
+	vector<float> pixelsPerUnit(objects.size());
+	for (size_t i = 0; i < objects.size(); ++i)
+		pixelsPerUnit[i] = PixelsPerUnit(objects[i]);
+
+	// loosen the error bound until the frame fits the budget
+	float bound = maxError;
+	size_t triangles = 0;
+	for (int step = 0; step <= BUDGET_STEPS; ++step)
+	{
+		triangles = 0;
+		for (size_t i = 0; i < objects.size(); ++i)
+		{
+			levels[i] = Pick(objects[i], pixelsPerUnit[i], bound);
+			triangles += Level(objects[i], levels[i]).range.indexCount / 3;
+		}
+		if (budget == 0 || triangles <= budget)
+			break;
+		bound *= 2.0f;
+	}
+	if (budget > 0 && triangles > budget)
+		++overBudget;
+
+	for (size_t i = 0; i < objects.size(); ++i)
+	{
+		if (current[objects[i]] != levels[i])
+		{
+			current[objects[i]] = levels[i];
+			++switches;
+		}
+	}
+	return triangles;
+}
+
+float LodSelector::PixelsPerUnit(uint32_t object) const
+{
+	if (orthographic)
+		return pixelScale;
+
+	// the nearest point of the bounding sphere, never closer than the near plane
+	const glm::vec4& sphere = spheres[object];
+	const float distance = glm::length(glm::vec3(sphere) - eye) - sphere.w;
+	return pixelScale / max(distance, 0.1f);
+}
+
+float LodSelector::Error(uint32_t object, uint8_t level, float pixelsPerUnit) const
+{
+	const GLuint sides = Level(object, level).sides;
+	if (sides == 0)
+		return 0.0f;
+
+	// a regular polygon's edges fall short of its circle by r (1 - cos(pi / sides)) at their middle
+	constexpr float PI = 3.14159265f;
+	return radii[object] * (1.0f - cos(PI / sides)) * pixelsPerUnit;
+}
+
+uint8_t LodSelector::Pick(uint32_t object, float pixelsPerUnit, float bound) const
+{
+	const uint8_t levelCount = (uint8_t)chains[chainOf[object]].size();
+	const uint8_t was = current[object];
+
+	// coarsest level within the bound; the error only grows with the level
+	uint8_t fits = 0;
+	while (fits + 1 < levelCount && Error(object, fits + 1, pixelsPerUnit) <= bound)
+		++fits;
+
+	// finer levels are taken at once, coarser ones only with some margin
+	if (fits <= was)
+		return fits;
+
+	uint8_t coarser = was;
+	while (coarser + 1 <= fits && Error(object, coarser + 1, pixelsPerUnit) <= bound * HYSTERESIS)
+		++coarser;
+	return coarser;
+}
+
+void LodSelector::Clear()
+{
+	chains.clear();
+	chainOf.clear();
+	spheres.clear();
+	radii.clear();
+	current.clear();
+	switches = 0;
+	overBudget = 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <vector>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "GeometryPool.h"
+
+// side counts of the coarser levels ShapeCreator adds below a shape's own number_of_sides
+constexpr GLuint LOD_SIDES[] = { 64, 32, 16, 8, 4 };
+
+// one tessellation of a shape inside the geometry pool; sides is 0 for exact shapes (cubes, planes)
+struct LodLevel
+{
+	GeometryRange range;
+	GLuint sides = 0;
+};
+
+// picks a level of detail per object from how far its silhouette, a circle approximated by a
+// polygon, strays from the real one on screen. A coarser level is only taken once it is well
+// inside the allowed error, so objects near a threshold do not pop back and forth, and the
+// allowed error is raised for the frame until the chosen levels fit the triangle budget
+class LodSelector
+{
+public:
+	// chains list their levels finest first; returns the id SetObject takes
+	uint32_t AddChain(const std::vector<LodLevel>& levels);
+
+	// where an object is and which chain it draws; radius is the world radius of its round section
+	void SetObject(uint32_t object, uint32_t chain, const BoundingSphere& sphere, float radius);
+
+	// pixels per world unit at distance 1 (perspective) or everywhere (orthographic)
+	void SetView(const glm::vec3& eye, float pixelScale, bool orthographic);
+
+	// allowed silhouette error in pixels, and triangles per frame (0 for no limit)
+	void SetMaxError(float pixels) { maxError = pixels; }
+	void SetBudget(size_t triangles) { budget = triangles; }
+
+	// levels[i] becomes the level of objects[i]; returns the triangles they add up to
+	size_t Select(const std::vector<uint32_t>& objects, std::vector<uint8_t>& levels);
+
+	const LodLevel& Level(uint32_t object, uint8_t level) const { return chains[chainOf[object]][level]; }
+
+	// totals since startup
+	size_t Switches() const { return switches; }
+	size_t OverBudgetFrames() const { return overBudget; }
+
+	void Clear();
+
+private:
+	// how far coarser levels have to stay below maxError before they are taken
+	static constexpr float HYSTERESIS = 0.75f;
+
+	// allowed error is doubled at most this often to meet the budget
+	static constexpr int BUDGET_STEPS = 8;
+
+	// screen size of one world unit at the object's nearest point
+	float PixelsPerUnit(uint32_t object) const;
+
+	// screen-space error of one level, in pixels
+	float Error(uint32_t object, uint8_t level, float pixelsPerUnit) const;
+
+	// level for one object at the given error bound, starting from where it was
+	uint8_t Pick(uint32_t object, float pixelsPerUnit, float bound) const;
+
+	std::vector<std::vector<LodLevel>> chains;
+	std::vector<uint32_t> chainOf;
+	std::vector<glm::vec4> spheres;
+	std::vector<float> radii;
+	std::vector<uint8_t> current;
+
+	glm::vec3 eye = glm::vec3(0.0f);
+	float pixelScale = 1.0f;
+	bool orthographic = false;
+
+	float maxError = 1.0f;
+	size_t budget = 0;
+
+	size_t switches = 0;
+	size_t overBudget = 0;
+};
@@ -17,19 +17,16 @@
 // camera
 #include <camera.h>
 
-struct GLMesh
+#include "Bounds.h"
+#include "LodSelector.h"
+
+// authoring record of a shape: what it was built from and how it was placed. MeshStore keeps
+// it in its cold table after registering; nothing here is read while drawing
+struct MeshAuthoring
 {
-	//vertex array
-	GLuint vao;
-	//vertex buffer
-	GLuint vbo;
-	//vertex buffer
-	GLuint vbos[2];
-	//indices of the mesh
-	GLuint nIndices;
+	//primitive type, used to group the indexing statistics
+	const char* shape = "mesh";
 
-	//indices to draw
-	std::vector<float> v;
 	//translation properties of the shape
 	std::vector<float> p;
 
@@ -46,18 +43,48 @@ struct GLMesh
 	glm::mat4 zrotation;
 	glm::mat4 rotation;
 	glm::mat4 translation;
-	glm::mat4 model;
-	glm::vec2 gUVScale;
 
 	// texture information
-	const char* texFilename;
-	GLuint textureId;
+	const char* texFilename = nullptr;
 
 	//texture wrapping mode: repeat texture
 	GLint gTextWrapMode = GL_REPEAT;
 	//GLint gTextWrapMode = GL_MIRRORED_REPEAT;
 	//GLint gTextWrapMode = GL_CLAMP_TO_EDGE;
 	//GLint gTextWrapMode = GL_CLAMP_TO_BORDER;
+};
+
+// a shape while ShapeCreator builds it: the authoring record plus what is derived from it.
+// MeshStore splits it into packed draw data and the cold authoring record, and keeps neither
+// the vertices nor a second copy of the draw fields
+struct GLMesh : MeshAuthoring
+{
+	//first index of the mesh inside the shared geometry pool
+	GLuint firstIndex = 0;
+	//offset added to the mesh-local indices
+	GLint baseVertex = 0;
+	//indices of the mesh
+	GLuint nIndices = 0;
+	//unique vertices after welding
+	GLuint nVertices = 0;
+	//the ranges above as level 0, followed by coarser tessellations for cones and cylinders
+	std::vector<LodLevel> lods;
+
+	//vertices to draw, as triangle soup; released once they are welded into the pool
+	std::vector<float> v;
+
+	glm::mat4 model;
+	// inverse-transpose of the model matrix, for the normals
+	glm::mat3 normalMatrix;
+
+	// bounds of the vertices as built, and after the model matrix
+	BoundingBox localBox;
+	BoundingSphere localSphere;
+	BoundingBox worldBox;
+	BoundingSphere worldSphere;
+	glm::vec2 gUVScale;
+
+	GLuint textureId = 0;
 
 
 
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+
+#include "MeshIndexer.h"
+
+using namespace std;
+
+map<string, MeshIndexer::Stats> MeshIndexer::stats;
+mutex MeshIndexer::statsMutex;
+
+namespace
+{
+// FNV-1a over the float bits, with -0 folded onto +0 so they weld together
+uint32_t UHashVertex(const float* v, size_t n)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < n; ++i)
+	{
+		float f = v[i] + 0.0f;
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(bits));
+		hash = (hash ^ bits) * 16777619u;
+	}
+	return hash;
+}
+
+bool UVertexEqual(const float* a, const float* b, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		if (a[i] != b[i])
+			return false;
+	return true;
+}
+
+// vertex scoring constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+constexpr int FORSYTH_CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRI_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+float UVertexScore(int cachePosition, int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;	// no triangles left to draw, never pick it
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+			score = LAST_TRI_SCORE;		// used by the last triangle: fixed score so the strip keeps going
+		else
+		{
+			const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// boost vertices with few triangles left so lone triangles are not stranded
+	score += VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+	return score;
+}
+}
+
+void MeshIndexer::UWeld(const vector<float>& soup, size_t floatsPerVertex,
+	vector<float>& vertices, vector<GLuint>& indices)
+{
+	const size_t soupCount = soup.size() / floatsPerVertex;
+
+	vertices.clear();
+	indices.clear();
+	vertices.reserve(soup.size());
+	indices.reserve(soupCount);
+
+	// open addressing table of welded vertex indices, at most half full
+	size_t tableSize = 1;
+	while (tableSize < soupCount * 2)
+		tableSize <<= 1;
+	vector<GLuint> table(tableSize, ~0u);
+
+	for (size_t i = 0; i < soupCount; ++i)
+	{
+		const float* v = &soup[i * floatsPerVertex];
+		size_t slot = UHashVertex(v, floatsPerVertex) & (tableSize - 1);
+
+		while (table[slot] != ~0u && !UVertexEqual(&vertices[table[slot] * floatsPerVertex], v, floatsPerVertex))
+			slot = (slot + 1) & (tableSize - 1);
+
+		if (table[slot] == ~0u)
+		{
+			table[slot] = (GLuint)(vertices.size() / floatsPerVertex);
+			vertices.insert(vertices.end(), v, v + floatsPerVertex);
+		}
+		indices.push_back(table[slot]);
+	}
+}
+
+void MeshIndexer::UOptimizeVertexCache(vector<GLuint>& indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// triangle adjacency per vertex
+	vector<int> remaining(vertexCount, 0);
+	for (GLuint index : indices)
+		++remaining[index];
+
+	vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+	vector<size_t> adjacency(indices.size());
+	vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t t = 0; t < triangleCount; ++t)
+		for (size_t k = 0; k < 3; ++k)
+			adjacency[fill[indices[t * 3 + k]]++] = t;
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = UVertexScore(-1, remaining[v]);
+
+	vector<float> triangleScore(triangleCount);
+	vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; ++t)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	vector<GLuint> output;
+	output.reserve(indices.size());
+
+	vector<GLuint> cache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	size_t scanStart = 0;
+	size_t best = 0;
+	float bestScore = -1.0f;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		if (triangleScore[t] > bestScore)
+		{
+			bestScore = triangleScore[t];
+			best = t;
+		}
+	}
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		// emit the best triangle and take it out of its vertices' adjacency
+		emitted[best] = true;
+		for (size_t k = 0; k < 3; ++k)
+		{
+			GLuint v = indices[best * 3 + k];
+			output.push_back(v);
+
+			size_t* begin = &adjacency[adjacencyOffset[v]];
+			size_t* end = begin + remaining[v];
+			*find(begin, end, best) = *(end - 1);
+			--remaining[v];
+		}
+
+		// move the triangle's vertices to the front of the LRU cache
+		vector<GLuint> newCache;
+		newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+		for (size_t k = 0; k < 3; ++k)
+			newCache.push_back(indices[best * 3 + k]);
+		for (GLuint v : cache)
+			if (find(newCache.begin(), newCache.end(), v) == newCache.end())
+				newCache.push_back(v);
+
+		// rescore every vertex that was or still is in the cache
+		for (size_t i = 0; i < newCache.size(); ++i)
+		{
+			GLuint v = newCache[i];
+			cachePosition[v] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+			vertexScore[v] = UVertexScore(cachePosition[v], remaining[v]);
+		}
+		if (newCache.size() > (size_t)FORSYTH_CACHE_SIZE)
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		cache.swap(newCache);
+
+		// the next triangle is the best one touching the cache
+		bestScore = -1.0f;
+		for (GLuint v : cache)
+		{
+			for (int a = 0; a < remaining[v]; ++a)
+			{
+				size_t t = adjacency[adjacencyOffset[v] + a];
+				triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+
+		// nothing adjacent left: continue with the next unemitted triangle in order
+		if (bestScore < 0.0f)
+		{
+			while (scanStart < triangleCount && emitted[scanStart])
+				++scanStart;
+			best = scanStart;
+		}
+	}
+
+	indices.swap(output);
+}
+
+void MeshIndexer::UOptimizeVertexFetch(vector<float>& vertices, size_t floatsPerVertex, vector<GLuint>& indices)
+{
+	const size_t vertexCount = vertices.size() / floatsPerVertex;
+
+	vector<GLuint> remap(vertexCount, ~0u);
+	vector<float> reordered;
+	reordered.reserve(vertices.size());
+
+	for (GLuint& index : indices)
+	{
+		if (remap[index] == ~0u)
+		{
+			remap[index] = (GLuint)(reordered.size() / floatsPerVertex);
+			const float* v = &vertices[index * floatsPerVertex];
+			reordered.insert(reordered.end(), v, v + floatsPerVertex);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+}
+
+double MeshIndexer::UComputeACMR(const vector<GLuint>& indices, size_t vertexCount, size_t cacheSize)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return 0.0;
+
+	// FIFO cache: timestamps of when each vertex entered the cache
+	vector<size_t> insertedAt(vertexCount, 0);
+	size_t misses = 0;
+
+	for (GLuint index : indices)
+	{
+		if (misses - insertedAt[index] >= cacheSize || insertedAt[index] == 0)
+		{
+			++misses;
+			insertedAt[index] = misses;
+		}
+	}
+
+	return (double)misses / (double)triangleCount;
+}
+
+void MeshIndexer::UIndex(const char* shape, const vector<float>& soup, size_t floatsPerVertex,
+	vector<float>& vertices, vector<GLuint>& indices)
+{
+	UWeld(soup, floatsPerVertex, vertices, indices);
+
+	const size_t vertexCount = vertices.size() / floatsPerVertex;
+	const double acmrWelded = UComputeACMR(indices, vertexCount);
+
+	UOptimizeVertexCache(indices, vertexCount);
+	UOptimizeVertexFetch(vertices, floatsPerVertex, indices);
+
+	const double acmrOptimized = UComputeACMR(indices, vertexCount);
+
+	lock_guard<mutex> lock(statsMutex);
+	Stats& s = stats[shape];
+	s.meshes += 1;
+	s.soupVertices += soup.size() / floatsPerVertex;
+	s.weldedVertices += vertexCount;
+	s.triangles += indices.size() / 3;
+	s.acmrWelded += acmrWelded;
+	s.acmrOptimized += acmrOptimized;
+}
+
+void MeshIndexer::UReportStats(ostream& out)
+{
+	out << "INFO: Indexed geometry (ACMR with a " << ACMR_CACHE_SIZE << " entry FIFO cache, 3.0 for triangle soup)" << endl;
+	for (const auto& entry : stats)
+	{
+		const Stats& s = entry.second;
+		out << "  " << setw(12) << left << entry.first << right
+			<< " meshes " << setw(3) << s.meshes
+			<< "  vertices " << setw(6) << s.soupVertices << " -> " << setw(6) << s.weldedVertices
+			<< "  ACMR " << fixed << setprecision(3) << s.acmrWelded / s.meshes
+			<< " -> " << s.acmrOptimized / s.meshes << defaultfloat << endl;
+	}
+}
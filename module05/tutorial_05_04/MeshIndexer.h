@@ -0,0 +1,55 @@
+#pragma once
+
+// general includes
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// turns the triangle soup built by ShapeCreator into indexed geometry
+class MeshIndexer
+{
+public:
+	// per primitive type totals, printed by UReportStats
+	struct Stats
+	{
+		size_t meshes = 0;
+		size_t soupVertices = 0;		// vertices before welding (3 per triangle)
+		size_t weldedVertices = 0;		// unique vertices after welding
+		size_t triangles = 0;
+		double acmrWelded = 0.0;		// cache misses per triangle, generation order (summed)
+		double acmrOptimized = 0.0;		// cache misses per triangle, after reordering (summed)
+	};
+
+	// post-transform cache size used to measure ACMR
+	static constexpr size_t ACMR_CACHE_SIZE = 16;
+
+	// merges bit-identical vertices (treating -0 and +0 as equal);
+	// soup is interleaved with floatsPerVertex floats per vertex
+	static void UWeld(const std::vector<float>& soup, size_t floatsPerVertex,
+		std::vector<float>& vertices, std::vector<GLuint>& indices);
+
+	// reorders triangles for post-transform cache hits (Forsyth's linear-speed algorithm)
+	static void UOptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+	// renumbers vertices in first-use order so fetches walk the buffer linearly
+	static void UOptimizeVertexFetch(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<GLuint>& indices);
+
+	// average cache miss ratio: vertex shader invocations per triangle with a FIFO cache
+	static double UComputeACMR(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize = ACMR_CACHE_SIZE);
+
+	// welds, optimizes and records the statistics under the given primitive type; safe on any thread
+	static void UIndex(const char* shape, const std::vector<float>& soup, size_t floatsPerVertex,
+		std::vector<float>& vertices, std::vector<GLuint>& indices);
+
+	// prints the before/after vertex counts and ACMR of every primitive type indexed so far
+	static void UReportStats(std::ostream& out);
+
+private:
+	static std::map<std::string, Stats> stats;
+	static std::mutex statsMutex;
+};
@@ -0,0 +1,91 @@
+#include <utility>
+
+#include "MeshStore.h"
+#include "Transform.h"
+
+using namespace std;
+
+MeshStore::Handle MeshStore::Register(const GLMesh& mesh)
+{
+	hot.firstIndex.push_back(mesh.firstIndex);
+	hot.baseVertex.push_back(mesh.baseVertex);
+	hot.indexCount.push_back(mesh.nIndices);
+	hot.textureId.push_back(mesh.textureId);
+	hot.model.push_back(mesh.model);
+	hot.normalMatrix.push_back(mesh.normalMatrix);
+	hot.uvScale.push_back(mesh.gUVScale);
+
+	hot.sphereX.push_back(0.0f);
+	hot.sphereY.push_back(0.0f);
+	hot.sphereZ.push_back(0.0f);
+	hot.sphereRadius.push_back(0.0f);
+
+	ColdMesh entry;
+	entry.authoring = mesh;
+	entry.lods = mesh.lods;
+	entry.localBox = mesh.localBox;
+	entry.localSphere = mesh.localSphere;
+	entry.worldBox = mesh.worldBox;
+	entry.worldSphere = mesh.worldSphere;
+	cold.push_back(move(entry));
+	isMoved.push_back(0);
+	SetSphere(cold.size() - 1, mesh.worldSphere);
+	++version;
+	return cold.size() - 1;
+}
+
+void MeshStore::SetSphere(Handle handle, const BoundingSphere& sphere)
+{
+	hot.sphereX[handle] = sphere.center.x;
+	hot.sphereY[handle] = sphere.center.y;
+	hot.sphereZ[handle] = sphere.center.z;
+	hot.sphereRadius[handle] = sphere.radius;
+}
+
+const ColdMesh& MeshStore::Get(Handle handle) const
+{
+	return cold[handle];
+}
+
+const RenderStore& MeshStore::Hot() const
+{
+	return hot;
+}
+
+void MeshStore::SetTransform(Handle handle, const glm::mat4& model)
+{
+	hot.model[handle] = model;
+	hot.normalMatrix[handle] = UNormalMatrix(model);
+
+	ColdMesh& mesh = cold[handle];
+	mesh.worldBox = UTransformBox(mesh.localBox, model);
+	mesh.worldSphere = UTransformSphere(mesh.localSphere, model);
+	SetSphere(handle, mesh.worldSphere);
+	if (!isMoved[handle])
+	{
+		isMoved[handle] = 1;
+		moved.push_back(handle);
+	}
+	++version;
+}
+
+void MeshStore::ClearMoved()
+{
+	for (Handle handle : moved)
+		isMoved[handle] = 0;
+	moved.clear();
+}
+
+size_t MeshStore::Size() const
+{
+	return cold.size();
+}
+
+void MeshStore::Clear()
+{
+	hot = RenderStore();
+	cold.clear();
+	moved.clear();
+	isMoved.clear();
+	++version;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+
+// the only per-mesh data a draw reads, kept as parallel packed arrays so the
+// render loop walks memory linearly and never copies a GLMesh
+struct RenderStore
+{
+	std::vector<GLuint> firstIndex;
+	std::vector<GLint> baseVertex;
+	std::vector<GLuint> indexCount;
+	std::vector<GLuint> textureId;
+	std::vector<glm::mat4> model;
+	std::vector<glm::mat3> normalMatrix;
+	std::vector<glm::vec2> uvScale;
+
+	// world bounding spheres split by component, so the frustum test can load four at a time
+	std::vector<float> sphereX;
+	std::vector<float> sphereY;
+	std::vector<float> sphereZ;
+	std::vector<float> sphereRadius;
+
+	size_t Size() const { return indexCount.size(); }
+};
+
+// everything else MeshStore keeps of a mesh, off the draw path: how it was authored, its
+// levels of detail and its bounds
+struct ColdMesh
+{
+	MeshAuthoring authoring;
+	std::vector<LodLevel> lods;
+	BoundingBox localBox;
+	BoundingSphere localSphere;
+	BoundingBox worldBox;
+	BoundingSphere worldSphere;
+};
+
+// owns meshes whose geometry is uploaded once into the shared GeometryPool and lives
+// for the whole session; callers keep a handle and only update the transform afterwards
+class MeshStore
+{
+public:
+	typedef size_t Handle;
+
+	// takes ownership of a mesh that has already been added to the pool by ShapeCreator;
+	// the draw data goes to the hot store, the rest to the cold side table
+	Handle Register(const GLMesh& mesh);
+
+	// authoring data (shape properties, separate rotations), levels and bounds
+	const ColdMesh& Get(Handle handle) const;
+
+	// packed draw data, indexed by handle
+	const RenderStore& Hot() const;
+
+	// replaces the model matrix (and its normal matrix and bounds) without touching any GL object
+	void SetTransform(Handle handle, const glm::mat4& model);
+
+	size_t Size() const;
+
+	// handles moved by SetTransform since the last ClearMoved, each listed once, so whatever
+	// indexes the world bounds (a SceneBVH, the LOD selector) only updates those
+	const std::vector<Handle>& Moved() const { return moved; }
+	void ClearMoved();
+
+	// bumped by every change to the draw data, so derived GPU lists know when to rebuild
+	unsigned Version() const { return version; }
+
+	// forgets every mesh; the geometry itself belongs to the pool
+	void Clear();
+
+private:
+	void SetSphere(Handle handle, const BoundingSphere& sphere);
+
+	RenderStore hot;
+	std::vector<ColdMesh> cold;
+	std::vector<Handle> moved;
+	std::vector<uint8_t> isMoved;
+	unsigned version = 0;
+};
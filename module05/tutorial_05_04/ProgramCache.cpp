@@ -0,0 +1,182 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "ProgramCache.h"
+
+using namespace std;
+
+// file layout: magic, entry count, then per entry key, format, size and the binary
+static const char CACHE_MAGIC[8] = { 'C', 'S', '3', '3', '0', 'P', 'B', '1' };
+
+// 64-bit FNV-1a, continued from hash
+static uint64_t UHashBytes(const char* bytes, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool ProgramCache::Open(const string& filename)
+{
+	path = filename;
+	entries.clear();
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	enabled = formats > 0;
+	if (!enabled)
+		return false;
+
+	// a binary is only valid for the driver that produced it
+	driver = string((const char*)glGetString(GL_VENDOR)) + "\n" + (const char*)glGetString(GL_RENDERER) + "\n"
+		+ (const char*)glGetString(GL_VERSION);
+
+	ifstream file(path, ios::binary | ios::ate);
+	if (!file)
+		return true;
+	const streamoff length = file.tellg();
+	file.seekg(0);
+
+	char magic[sizeof(CACHE_MAGIC)] = {};
+	uint32_t count = 0;
+	file.read(magic, sizeof(magic));
+	file.read((char*)&count, sizeof(count));
+	if (!file || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0)
+		return true;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint64_t key = 0;
+		uint32_t format = 0;
+		uint32_t size = 0;
+		file.read((char*)&key, sizeof(key));
+		file.read((char*)&format, sizeof(format));
+		file.read((char*)&size, sizeof(size));
+
+		// a size past the end of the file means the file is damaged, so nothing in it is trusted;
+		// the next Save writes it again from the programs built this run
+		if (!file || size > length - file.tellg())
+		{
+			cout << "WARNING: program cache " << path << " is damaged, ignoring it" << endl;
+			entries.clear();
+			dirty = true;
+			break;
+		}
+
+		Entry entry;
+		entry.format = format;
+		entry.binary.resize(size);
+		file.read(entry.binary.data(), size);
+		entries[key] = move(entry);
+	}
+	return true;
+}
+
+uint64_t ProgramCache::Key(const char* vertexSource, const char* fragmentSource) const
+{
+	// the separators keep "ab" + "c" apart from "a" + "bc"
+	uint64_t hash = UHashBytes(vertexSource, strlen(vertexSource) + 1);
+	hash = UHashBytes(fragmentSource, strlen(fragmentSource) + 1, hash);
+	return UHashBytes(driver.data(), driver.size(), hash);
+}
+
+bool ProgramCache::Load(uint64_t key, GLuint program)
+{
+	if (!enabled)
+		return false;
+
+	auto found = entries.find(key);
+	if (found == entries.end())
+	{
+		++misses;
+		return false;
+	}
+
+	const auto start = chrono::steady_clock::now();
+	Entry& entry = found->second;
+	glProgramBinary(program, entry.format, entry.binary.data(), (GLsizei)entry.binary.size());
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	loadMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	if (!linked)
+	{
+		// the driver can refuse a binary for reasons the key does not capture; compile instead
+		++rejected;
+		entries.erase(found);
+		dirty = true;
+		return false;
+	}
+
+	entry.used = true;
+	++hits;
+	return true;
+}
+
+void ProgramCache::Store(uint64_t key, GLuint program)
+{
+	if (!enabled)
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	Entry entry;
+	entry.binary.resize(length);
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &entry.format, entry.binary.data());
+	entry.binary.resize(written);
+	entry.used = true;
+	entries[key] = move(entry);
+	dirty = true;
+}
+
+bool ProgramCache::Save() const
+{
+	size_t unused = 0;
+	for (auto& entry : entries)
+		unused += !entry.second.used;
+	if (!enabled || (!dirty && unused == 0))
+		return true;
+
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+		return false;
+
+	const uint32_t count = (uint32_t)(entries.size() - unused);
+	file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	file.write((const char*)&count, sizeof(count));
+	for (auto& entry : entries)
+	{
+		if (!entry.second.used)
+			continue;
+
+		const uint32_t format = entry.second.format;
+		const uint32_t size = (uint32_t)entry.second.binary.size();
+		file.write((const char*)&entry.first, sizeof(entry.first));
+		file.write((const char*)&format, sizeof(format));
+		file.write((const char*)&size, sizeof(size));
+		file.write(entry.second.binary.data(), size);
+	}
+	return (bool)file;
+}
+
+void ProgramCache::Report(ostream& out) const
+{
+	if (!enabled)
+	{
+		out << "INFO: Program cache off, " << compileMilliseconds << " ms to build the shader programs" << endl;
+		return;
+	}
+
+	out << "INFO: Program cache " << path << " (" << (hits > 0 && misses == 0 && rejected == 0 ? "warm" : "cold") << "): "
+		<< hits << " programs loaded in " << loadMilliseconds << " ms, " << misses << " missing and " << rejected
+		<< " rejected binaries compiled from source; " << compileMilliseconds << " ms to build the shader programs" << endl;
+}
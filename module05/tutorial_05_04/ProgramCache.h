@@ -0,0 +1,62 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// linked program binaries kept in one file between launches, so a warm start skips compiling and
+// linking. Entries are keyed by a hash of the shader sources and the driver's vendor, renderer and
+// version strings, so an edited shader or an updated driver simply misses
+class ProgramCache
+{
+public:
+	// reads filename if it exists; returns false (and caches nothing) when the driver offers no
+	// program binary format. Needs a current context
+	bool Open(const std::string& filename);
+
+	bool Enabled() const { return enabled; }
+
+	// key of a program built from these sources with this driver
+	uint64_t Key(const char* vertexSource, const char* fragmentSource) const;
+
+	// glProgramBinary into program; false when there is no entry or the driver rejects it, in
+	// which case program is still unlinked and can be compiled from source
+	bool Load(uint64_t key, GLuint program);
+
+	// keeps the binary of a freshly linked program, created with
+	// GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	void Store(uint64_t key, GLuint program);
+
+	// writes the entries used by this run back when anything changed; stale ones are dropped
+	bool Save() const;
+
+	// time spent loading binaries and compiling sources, passed in by the caller
+	void CountCompile(double milliseconds) { compileMilliseconds += milliseconds; }
+	void Report(std::ostream& out) const;
+
+private:
+	struct Entry
+	{
+		GLenum format = 0;
+		std::vector<char> binary;
+		bool used = false;
+	};
+
+	bool enabled = false;
+	std::string path;
+	std::string driver;
+	std::unordered_map<uint64_t, Entry> entries;
+	bool dirty = false;
+
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t rejected = 0;
+	double loadMilliseconds = 0.0;
+	double compileMilliseconds = 0.0;
+};
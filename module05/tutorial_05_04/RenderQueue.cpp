@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cmath>
+
+#include "RenderQueue.h"
+
+using namespace std;
+
+uint64_t RenderQueue::MakeKey(uint32_t program, uint32_t texture, uint32_t vertexArray, uint32_t depth)
+{
+	return ((uint64_t)(program & 0xFF) << 56) | ((uint64_t)(texture & 0xFFFF) << 40)
+		| ((uint64_t)(vertexArray & 0xFFFF) << DEPTH_BITS) | (depth & ((1u << DEPTH_BITS) - 1));
+}
+
+uint32_t RenderQueue::QuantizeDepth(float depth, float nearPlane, float farPlane)
+{
+	const float t = min(max((depth - nearPlane) / (farPlane - nearPlane), 0.0f), 1.0f);
+	return (uint32_t)(t * ((1u << DEPTH_BITS) - 1));
+}
+
+void RenderQueue::Clear()
+{
+	keys.clear();
+	items.clear();
+}
+
+void RenderQueue::Add(uint64_t key, uint32_t item)
+{
+	keys.push_back(key);
+	items.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	if (keys.size() < 2)
+		return;
+
+	// bytes that differ somewhere between the keys
+	uint64_t varying = 0;
+	for (uint64_t key : keys)
+		varying |= key ^ keys[0];
+
+	sortedKeys.resize(keys.size());
+	sortedItems.resize(items.size());
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		if (((varying >> shift) & 0xFF) == 0)
+			continue;
+
+		size_t offsets[256] = {};
+		for (uint64_t key : keys)
+			++offsets[(key >> shift) & 0xFF];
+		size_t sum = 0;
+		for (size_t& offset : offsets)
+		{
+			const size_t count = offset;
+			offset = sum;
+			sum += count;
+		}
+
+		// stable, so the lower digits sorted by earlier passes keep their order
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			const size_t target = offsets[(keys[i] >> shift) & 0xFF]++;
+			sortedKeys[target] = keys[i];
+			sortedItems[target] = items[i];
+		}
+		keys.swap(sortedKeys);
+		items.swap(sortedItems);
+	}
+}
+
+size_t RenderQueue::StateChanges() const
+{
+	const uint64_t stateBits = ~(uint64_t)((1u << DEPTH_BITS) - 1);
+	size_t changes = 0;
+	for (size_t i = 1; i < keys.size(); ++i)
+		changes += (keys[i] & stateBits) != (keys[i - 1] & stateBits);
+	return changes;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <vector>
+
+// draws of a frame ordered by a 64-bit key: program in the top 8 bits, then texture (16),
+// vertex array (16) and quantized view depth (24), so sorting groups draws by the state they
+// need, most expensive change first, and runs each group front to back
+class RenderQueue
+{
+public:
+	static constexpr int DEPTH_BITS = 24;
+
+	// GL names are truncated to their field; only equality matters for the order
+	static uint64_t MakeKey(uint32_t program, uint32_t texture, uint32_t vertexArray, uint32_t depth);
+
+	// view depth between the clip planes, scaled to DEPTH_BITS
+	static uint32_t QuantizeDepth(float depth, float nearPlane, float farPlane);
+
+	void Clear();
+	void Add(uint64_t key, uint32_t item);
+
+	// least significant digit radix sort, 8 bits per pass; passes over a byte that every key
+	// shares are skipped, so a frame with few programs and textures pays for few passes
+	void Sort();
+
+	size_t Size() const { return items.size(); }
+	const std::vector<uint32_t>& Items() const { return items; }
+
+	// how many neighbours in the current order differ in program, texture or vertex array
+	size_t StateChanges() const;
+
+private:
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> items;
+
+	// the other half of every radix pass
+	std::vector<uint64_t> sortedKeys;
+	std::vector<uint32_t> sortedItems;
+};
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cfloat>
+#include <utility>
+
+#include "SceneBVH.h"
+
+using namespace std;
+
+// half the surface area is enough to compare split costs
+static float HalfArea(const BoundingBox& box)
+{
+	const glm::vec3 extent = glm::max(box.max - box.min, glm::vec3(0.0f));
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+static BoundingBox EmptyBox()
+{
+	BoundingBox box;
+	box.min = glm::vec3(FLT_MAX);
+	box.max = glm::vec3(-FLT_MAX);
+	return box;
+}
+
+void SceneBVH::Build(const vector<BoundingBox>& objectBoxes)
+{
+	Clear();
+	boxes = objectBoxes;
+	if (boxes.empty())
+		return;
+
+	const uint32_t count = (uint32_t)boxes.size();
+	objects.resize(count);
+	vector<glm::vec3> centers(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		objects[i] = i;
+		centers[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+	}
+
+	// a binary tree with at least one object per leaf never needs more nodes than this
+	nodes.reserve(2 * (size_t)count);
+	nodes.emplace_back();
+	nodes[0].count = count;
+	nodes[0].box = LeafBox(nodes[0]);
+
+	vector<pair<uint32_t, size_t>> stack;
+	stack.emplace_back(0, 1);
+	while (!stack.empty())
+	{
+		const uint32_t node = stack.back().first;
+		const size_t level = stack.back().second;
+		stack.pop_back();
+		depth = max(depth, level);
+
+		if (Split(node, centers))
+		{
+			stack.emplace_back(nodes[node].left, level + 1);
+			stack.emplace_back(nodes[node].left + 1, level + 1);
+		}
+	}
+
+	leafOf.resize(count);
+	for (uint32_t i = 0; i < (uint32_t)nodes.size(); ++i)
+	{
+		if (!IsLeaf(nodes[i]))
+			continue;
+		for (uint32_t j = nodes[i].first; j < nodes[i].first + nodes[i].count; ++j)
+			leafOf[objects[j]] = i;
+	}
+}
+
+bool SceneBVH::Split(uint32_t index, const vector<glm::vec3>& centers)
+{
+	const Node node = nodes[index];
+	if (node.count <= 1)
+		return false;
+
+	// bin along the axis where the centers spread the most
+	glm::vec3 lowest(FLT_MAX), highest(-FLT_MAX);
+	for (uint32_t i = node.first; i < node.first + node.count; ++i)
+	{
+		lowest = glm::min(lowest, centers[objects[i]]);
+		highest = glm::max(highest, centers[objects[i]]);
+	}
+	const glm::vec3 spread = highest - lowest;
+	const int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+
+	uint32_t middle;
+	if (spread[axis] <= 0.0f)
+	{
+		// every center in the same place: no plane separates them, halve the list instead
+		if (node.count <= MAX_LEAF_OBJECTS)
+			return false;
+		middle = node.first + node.count / 2;
+	}
+	else
+	{
+		const float scale = SAH_BINS / spread[axis];
+		auto binOf = [&](uint32_t object) {
+			return min(SAH_BINS - 1, (int)((centers[object][axis] - lowest[axis]) * scale));
+		};
+
+		BoundingBox binBoxes[SAH_BINS];
+		uint32_t binCounts[SAH_BINS] = {};
+		for (auto& box : binBoxes)
+			box = EmptyBox();
+		for (uint32_t i = node.first; i < node.first + node.count; ++i)
+		{
+			const int bin = binOf(objects[i]);
+			binBoxes[bin] = UMergeBoxes(binBoxes[bin], boxes[objects[i]]);
+			++binCounts[bin];
+		}
+
+		// cost of every plane between two bins, sweeping from both ends
+		float leftCost[SAH_BINS - 1];
+		BoundingBox sweep = EmptyBox();
+		uint32_t sweepCount = 0;
+		for (int i = 0; i < SAH_BINS - 1; ++i)
+		{
+			sweep = UMergeBoxes(sweep, binBoxes[i]);
+			sweepCount += binCounts[i];
+			leftCost[i] = sweepCount * HalfArea(sweep);
+		}
+
+		int bestPlane = 0;
+		float bestCost = FLT_MAX;
+		sweep = EmptyBox();
+		sweepCount = 0;
+		for (int i = SAH_BINS - 1; i > 0; --i)
+		{
+			sweep = UMergeBoxes(sweep, binBoxes[i]);
+			sweepCount += binCounts[i];
+			const float cost = leftCost[i - 1] + sweepCount * HalfArea(sweep);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestPlane = i;
+			}
+		}
+
+		// small nodes stay leaves unless visiting two children (about one box test) and their
+		// objects is cheaper than testing everything
+		const float nodeArea = HalfArea(node.box);
+		if (node.count <= MAX_LEAF_OBJECTS && nodeArea + bestCost >= node.count * nodeArea)
+			return false;
+
+		middle = (uint32_t)(partition(objects.begin() + node.first, objects.begin() + node.first + node.count,
+			[&](uint32_t object) { return binOf(object) < bestPlane; }) - objects.begin());
+	}
+
+	const uint32_t left = (uint32_t)nodes.size();
+	nodes.emplace_back();
+	nodes.emplace_back();
+
+	nodes[left].first = node.first;
+	nodes[left].count = middle - node.first;
+	nodes[left].parent = index;
+	nodes[left].box = LeafBox(nodes[left]);
+
+	nodes[left + 1].first = middle;
+	nodes[left + 1].count = node.first + node.count - middle;
+	nodes[left + 1].parent = index;
+	nodes[left + 1].box = LeafBox(nodes[left + 1]);
+
+	nodes[index].left = left;
+	return true;
+}
+
+BoundingBox SceneBVH::LeafBox(const Node& node) const
+{
+	BoundingBox box = boxes[objects[node.first]];
+	for (uint32_t i = node.first + 1; i < node.first + node.count; ++i)
+		box = UMergeBoxes(box, boxes[objects[i]]);
+	return box;
+}
+
+void SceneBVH::Refit(const vector<BoundingBox>& objectBoxes)
+{
+	boxes = objectBoxes;
+
+	// children are always created after their parent, so walking backwards visits them first
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		Node& node = nodes[i];
+		if (IsLeaf(node))
+			node.box = LeafBox(node);
+		else
+			node.box = UMergeBoxes(nodes[node.left].box, nodes[node.left + 1].box);
+	}
+}
+
+void SceneBVH::Refit(uint32_t object, const BoundingBox& box)
+{
+	boxes[object] = box;
+
+	uint32_t index = leafOf[object];
+	nodes[index].box = LeafBox(nodes[index]);
+	while (index != 0)
+	{
+		index = nodes[index].parent;
+		Node& node = nodes[index];
+		const BoundingBox merged = UMergeBoxes(nodes[node.left].box, nodes[node.left + 1].box);
+
+		// nothing above changes once a box stays the same
+		if (merged.min == node.box.min && merged.max == node.box.max)
+			break;
+		node.box = merged;
+	}
+}
+
+size_t SceneBVH::Cull(const Frustum& frustum, vector<uint32_t>& visible) const
+{
+	if (nodes.empty())
+		return 0;
+
+	// holds at most one pending sibling per level
+	size_t visited = 0;
+	vector<uint32_t> stack;
+	stack.reserve(depth + 1);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		++visited;
+
+		const FrustumTest test = frustum.ClassifyBox(node.box);
+		if (test == FRUSTUM_OUTSIDE)
+			continue;
+
+		if (test == FRUSTUM_INSIDE)
+		{
+			// the whole subtree is visible and its objects are contiguous
+			visible.insert(visible.end(), objects.begin() + node.first, objects.begin() + node.first + node.count);
+		}
+		else if (IsLeaf(node))
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				if (frustum.TestBox(boxes[objects[i]]))
+					visible.push_back(objects[i]);
+			}
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.left + 1);
+		}
+	}
+	return visited;
+}
+
+int64_t SceneBVH::Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance,
+	const function<bool(uint32_t object, float& distance)>& hitObject) const
+{
+	int64_t hit = -1;
+	if (nodes.empty())
+		return hit;
+
+	// division by zero gives infinities, which the slab test handles
+	const glm::vec3 inverseDirection = 1.0f / direction;
+
+	float entry;
+	if (!URayIntersectsBox(origin, inverseDirection, nodes[0].box, distance, entry))
+		return hit;
+
+	vector<pair<uint32_t, float>> stack;
+	stack.reserve(depth + 1);
+	stack.emplace_back(0, entry);
+	while (!stack.empty())
+	{
+		const uint32_t index = stack.back().first;
+		const float nodeEntry = stack.back().second;
+		stack.pop_back();
+
+		// a closer hit was found after this node was pushed
+		if (nodeEntry > distance)
+			continue;
+
+		const Node& node = nodes[index];
+		if (IsLeaf(node))
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				const uint32_t object = objects[i];
+				if (URayIntersectsBox(origin, inverseDirection, boxes[object], distance, entry) && hitObject(object, distance))
+					hit = object;
+			}
+			continue;
+		}
+
+		// visit the nearer child first by pushing it last
+		float leftEntry, rightEntry;
+		const bool leftHit = URayIntersectsBox(origin, inverseDirection, nodes[node.left].box, distance, leftEntry);
+		const bool rightHit = URayIntersectsBox(origin, inverseDirection, nodes[node.left + 1].box, distance, rightEntry);
+		if (leftHit && rightHit)
+		{
+			const bool leftFirst = leftEntry <= rightEntry;
+			stack.emplace_back(leftFirst ? node.left + 1 : node.left, leftFirst ? rightEntry : leftEntry);
+			stack.emplace_back(leftFirst ? node.left : node.left + 1, leftFirst ? leftEntry : rightEntry);
+		}
+		else if (leftHit)
+			stack.emplace_back(node.left, leftEntry);
+		else if (rightHit)
+			stack.emplace_back(node.left + 1, rightEntry);
+	}
+	return hit;
+}
+
+void SceneBVH::Clear()
+{
+	nodes.clear();
+	objects.clear();
+	leafOf.clear();
+	boxes.clear();
+	depth = 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "Frustum.h"
+
+// bounding volume hierarchy over the world boxes of the scene objects, built with a
+// binned surface area heuristic; used to cull whole subtrees against the frustum and
+// to find what a ray hits without testing every object
+class SceneBVH
+{
+public:
+	// objects are identified by their index in boxes
+	void Build(const std::vector<BoundingBox>& boxes);
+
+	// keeps the tree, recomputes every node box bottom-up; boxes must be the same objects
+	void Refit(const std::vector<BoundingBox>& boxes);
+
+	// moves one object and fixes the boxes on the path to the root
+	void Refit(uint32_t object, const BoundingBox& box);
+
+	// appends the objects whose box touches the frustum; returns how many nodes were visited
+	size_t Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	// nearest object along origin + t * direction; hitObject is asked about every object whose
+	// box the ray reaches before the best hit so far and must lower distance when it finds a
+	// closer hit. Returns the object, or -1 when nothing was hit
+	int64_t Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance,
+		const std::function<bool(uint32_t object, float& distance)>& hitObject) const;
+
+	size_t Objects() const { return boxes.size(); }
+	size_t Nodes() const { return nodes.size(); }
+	size_t Depth() const { return depth; }
+
+	void Clear();
+
+private:
+	// a leaf has no children; every node owns objects[first, first + count), so a subtree
+	// that is completely inside the frustum can be accepted without visiting it
+	struct Node
+	{
+		BoundingBox box;
+		uint32_t left = 0;		// right child is left + 1; 0 for a leaf (the root is never a child)
+		uint32_t first = 0;
+		uint32_t count = 0;
+		uint32_t parent = 0;
+	};
+
+	static constexpr uint32_t MAX_LEAF_OBJECTS = 4;
+	static constexpr int SAH_BINS = 16;
+
+	bool IsLeaf(const Node& node) const { return node.left == 0; }
+
+	// splits node in place if the SAH says it is worth it; returns whether it did
+	bool Split(uint32_t node, const std::vector<glm::vec3>& centers);
+	BoundingBox LeafBox(const Node& node) const;
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> objects;		// object indices, grouped by leaf
+	std::vector<uint32_t> leafOf;		// object index -> leaf node
+	std::vector<BoundingBox> boxes;		// object index -> box
+	size_t depth = 0;
+};
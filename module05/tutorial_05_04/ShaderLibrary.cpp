@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+#include <sys/types.h>
+#include <sys/stat.h>	// modification times
+
+#include "ShaderLibrary.h"
+#include "StateCache.h"
+
+using namespace std;
+
+constexpr double ShaderLibrary::RELOAD_INTERVAL;
+constexpr unsigned ShaderLibrary::FALLBACK_POLLS;
+
+static const GLenum SHADER_STAGES[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+static const char* const STAGE_NAMES[2] = { "VERTEX", "FRAGMENT" };
+
+void ShaderLibrary::Create(ProgramCache* programCache)
+{
+	cache = programCache;
+
+	// let the driver use as many compiler threads as it likes
+	parallel = GLEW_KHR_parallel_shader_compile != GL_FALSE;
+	if (parallel)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+}
+
+void ShaderLibrary::Add(ShaderProgram& program, const string& vertexFile, const string& fragmentFile)
+{
+	Entry entry;
+	entry.program = &program;
+	entry.files[0] = vertexFile;
+	entry.files[1] = fragmentFile;
+	entries.push_back(entry);
+}
+
+bool ShaderLibrary::ReadFile(const string& filename, string& contents)
+{
+	ifstream file(filename, ios::binary);
+	if (!file)
+		return false;
+	contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	return true;
+}
+
+bool ShaderLibrary::FileStatus(const string& filename, long long& modified, long long& size)
+{
+	struct stat status;
+	if (stat(filename.c_str(), &status) != 0)
+		return false;
+	modified = (long long)status.st_mtime;
+	size = (long long)status.st_size;
+	return true;
+}
+
+bool ShaderLibrary::Build()
+{
+	// everything goes to the driver before the first status query
+	for (Entry& entry : entries)
+	{
+		for (int stage = 0; stage < 2; ++stage)
+		{
+			FileStatus(entry.files[stage], entry.modified[stage], entry.sizes[stage]);
+			if (!ReadFile(entry.files[stage], entry.pendingSources[stage]))
+			{
+				cout << "ERROR: could not read the shader " << entry.files[stage] << endl;
+				return false;
+			}
+		}
+
+		// the same sources on the same driver were linked before: take the binary
+		if (cache)
+		{
+			entry.key = cache->Key(entry.pendingSources[0].c_str(), entry.pendingSources[1].c_str());
+			GLuint binary = glCreateProgram();
+			if (cache->Load(entry.key, binary))
+			{
+				entry.sources[0] = entry.pendingSources[0];
+				entry.sources[1] = entry.pendingSources[1];
+				Swap(entry, binary);
+				continue;
+			}
+			glDeleteProgram(binary);
+		}
+		Submit(entry, 0.0);
+	}
+
+	// then collect them in whatever order they finish
+	bool built = true;
+	for (bool waiting = true; waiting;)
+	{
+		waiting = false;
+		for (Entry& entry : entries)
+		{
+			if (entry.pending == 0)
+				continue;
+			if (!Finished(entry))
+			{
+				waiting = true;
+				continue;
+			}
+			built = Finish(entry) && built;
+		}
+		if (waiting)
+			this_thread::yield();
+	}
+	return built;
+}
+
+void ShaderLibrary::Submit(Entry& entry, double now)
+{
+	entry.pending = glCreateProgram();
+	for (int stage = 0; stage < 2; ++stage)
+	{
+		const char* source = entry.pendingSources[stage].c_str();
+		entry.shaders[stage] = glCreateShader(SHADER_STAGES[stage]);
+		glShaderSource(entry.shaders[stage], 1, &source, NULL);
+		glCompileShader(entry.shaders[stage]);
+		glAttachShader(entry.pending, entry.shaders[stage]);
+	}
+
+	// keep the linked binary retrievable for the program cache
+	if (cache && cache->Enabled())
+		glProgramParameteri(entry.pending, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	glLinkProgram(entry.pending);
+	if (cache)
+		entry.key = cache->Key(entry.pendingSources[0].c_str(), entry.pendingSources[1].c_str());
+	entry.submitted = now;
+	entry.polls = 0;
+}
+
+bool ShaderLibrary::Finished(Entry& entry)
+{
+	// only a guess: the GL_LINK_STATUS read that follows blocks if the link is still running
+	if (!parallel)
+		return ++entry.polls >= FALLBACK_POLLS;
+
+	GLint completed = GL_FALSE;
+	glGetProgramiv(entry.pending, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed != GL_FALSE;
+}
+
+bool ShaderLibrary::Finish(Entry& entry)
+{
+	GLint success = 0;
+	glGetProgramiv(entry.pending, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		char infoLog[512];
+		for (int stage = 0; stage < 2; ++stage)
+		{
+			glGetShaderiv(entry.shaders[stage], GL_COMPILE_STATUS, &success);
+			if (!success)
+			{
+				glGetShaderInfoLog(entry.shaders[stage], sizeof(infoLog), NULL, infoLog);
+				cout << "ERROR::SHADER::" << STAGE_NAMES[stage] << "::COMPILATION_FAILED (" << entry.files[stage] << ")\n" << infoLog << endl;
+			}
+		}
+		glGetProgramInfoLog(entry.pending, sizeof(infoLog), NULL, infoLog);
+		cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED (" << entry.files[0] << ", " << entry.files[1] << ")\n" << infoLog << endl;
+	}
+
+	// the linked program keeps the compiled code; the shader objects are no longer needed
+	for (int stage = 0; stage < 2; ++stage)
+	{
+		glDetachShader(entry.pending, entry.shaders[stage]);
+		glDeleteShader(entry.shaders[stage]);
+		entry.shaders[stage] = 0;
+	}
+
+	const GLuint linked = entry.pending;
+	entry.pending = 0;
+
+	// sources that do not build are not retried until they change again
+	entry.sources[0] = entry.pendingSources[0];
+	entry.sources[1] = entry.pendingSources[1];
+	if (!success)
+	{
+		glDeleteProgram(linked);
+		return false;
+	}
+
+	if (cache)
+		cache->Store(entry.key, linked);
+	Swap(entry, linked);
+	return true;
+}
+
+void ShaderLibrary::Swap(Entry& entry, GLuint linked)
+{
+	// the replacement is complete, uniforms included, before any draw can see it
+	ShaderProgram replacement;
+	replacement.id = linked;
+	replacement.Reflect();
+	if (onLinked)
+		onLinked(replacement);
+
+	const GLuint old = entry.program->id;
+	*entry.program = replacement;
+	if (old != 0)
+	{
+		// a name the cache still holds as current could come back for another program
+		UStateCache().UseProgram(linked);
+		glDeleteProgram(old);
+	}
+}
+
+void ShaderLibrary::Update(double now)
+{
+	for (Entry& entry : entries)
+	{
+		if (entry.pending == 0 || !Finished(entry))
+			continue;
+
+		const double milliseconds = (now - entry.submitted) * 1000.0;
+		if (Finish(entry))
+		{
+			++reloads;
+			reloadMilliseconds += milliseconds;
+			cout << "INFO: Reloaded " << entry.files[0] << " + " << entry.files[1] << ", swapped in after " << milliseconds << " ms" << endl;
+		}
+		else
+		{
+			++failedReloads;
+			cout << "WARNING: keeping the previous program for " << entry.files[0] << " + " << entry.files[1] << endl;
+		}
+	}
+
+	if (!hotReload || now - lastCheck < RELOAD_INTERVAL)
+		return;
+	lastCheck = now;
+
+	// only files whose time or size changed are read; the contents decide, so saving without
+	// an edit does not rebuild anything
+	for (Entry& entry : entries)
+	{
+		if (entry.pending != 0)
+			continue;
+
+		long long modified[2], sizes[2];
+		if (!FileStatus(entry.files[0], modified[0], sizes[0]) || !FileStatus(entry.files[1], modified[1], sizes[1]))
+			continue;
+		if (modified[0] == entry.modified[0] && sizes[0] == entry.sizes[0] && modified[1] == entry.modified[1] && sizes[1] == entry.sizes[1])
+			continue;
+
+		string current[2];
+		if (!ReadFile(entry.files[0], current[0]) || !ReadFile(entry.files[1], current[1]))
+			continue;	// e.g. in the middle of being saved
+		for (int stage = 0; stage < 2; ++stage)
+		{
+			entry.modified[stage] = modified[stage];
+			entry.sizes[stage] = sizes[stage];
+		}
+		if (current[0] == entry.sources[0] && current[1] == entry.sources[1])
+			continue;
+
+		entry.pendingSources[0] = current[0];
+		entry.pendingSources[1] = current[1];
+		Submit(entry, now);
+	}
+}
+
+void ShaderLibrary::Report(ostream& out) const
+{
+	out << "INFO: Shader programs: " << entries.size() << " built from files, "
+		<< (parallel ? "compiled in parallel (GL_KHR_parallel_shader_compile)" : "compiled one at a time (no GL_KHR_parallel_shader_compile)");
+	if (reloads + failedReloads > 0)
+		out << ", " << reloads << " reloads swapped in after " << reloadMilliseconds / max(reloads, (size_t)1) << " ms on average, "
+			<< failedReloads << " failed";
+	out << endl;
+}
+
+void ShaderLibrary::Destroy()
+{
+	for (Entry& entry : entries)
+	{
+		if (entry.pending != 0)
+		{
+			for (int stage = 0; stage < 2; ++stage)
+				glDeleteShader(entry.shaders[stage]);
+			glDeleteProgram(entry.pending);
+		}
+		glDeleteProgram(entry.program->id);
+		entry.program->id = 0;
+		entry.program->uniforms.clear();
+	}
+	entries.clear();
+}
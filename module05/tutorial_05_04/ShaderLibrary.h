@@ -0,0 +1,103 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+#include "ProgramCache.h"
+#include "ShaderProgram.h"
+
+// the shader programs, built from GLSL files. Every compile and link is submitted before any status
+// is read, so with GL_KHR_parallel_shader_compile the driver works on all of them at once and
+// GL_COMPLETION_STATUS_KHR tells when one is done without waiting for it. The files are watched
+// afterwards: an edited program is rebuilt in the background and replaces the old one between
+// frames, only once it has linked. Without the extension there is no way to ask without waiting:
+// a reload is given FALLBACK_POLLS frames, after which GL_LINK_STATUS is read and still stalls the
+// frame if the driver has not finished, and always does on a driver that compiles on the calling thread
+class ShaderLibrary
+{
+public:
+	// seconds between two looks at the files
+	static constexpr double RELOAD_INTERVAL = 0.5;
+	// without GL_KHR_parallel_shader_compile, times a build is polled before its status is read
+	static constexpr unsigned FALLBACK_POLLS = 3;
+
+	// optionally with a cache of linked binaries; needs a current context
+	void Create(ProgramCache* programCache = nullptr);
+
+	// program is filled in by Build and replaced as a whole by every reload
+	void Add(ShaderProgram& program, const std::string& vertexFile, const std::string& fragmentFile);
+
+	// runs on every program that has just linked, before anything draws with it (for the uniforms
+	// that do not live in buffers)
+	void SetOnLinked(std::function<void(ShaderProgram&)> callback) { onLinked = callback; }
+
+	// reads every file and builds every program; false when a file is missing or a program fails
+	bool Build();
+
+	// once per frame: swaps in the rebuilt programs that are done, and every RELOAD_INTERVAL
+	// resubmits the ones whose files changed; a program that fails to build keeps the old one
+	void Update(double now);
+
+	void SetHotReload(bool enabled) { hotReload = enabled; }
+	bool Parallel() const { return parallel; }
+
+	void Report(std::ostream& out) const;
+
+	void Destroy();
+
+private:
+	struct Entry
+	{
+		ShaderProgram* program = nullptr;
+		std::string files[2];
+		std::string sources[2];		// what the current program was built from
+		// modification time and size of the files when they were last read
+		long long modified[2] = {};
+		long long sizes[2] = {};
+
+		// the build in flight, if any
+		GLuint pending = 0;
+		GLuint shaders[2] = {};
+		std::string pendingSources[2];
+		uint64_t key = 0;
+		double submitted = 0.0;
+		unsigned polls = 0;
+	};
+
+	static bool ReadFile(const std::string& filename, std::string& contents);
+
+	// modification time and size of a file; false when it cannot be looked at
+	static bool FileStatus(const std::string& filename, long long& modified, long long& size);
+
+	// compiles and links without asking for any status
+	void Submit(Entry& entry, double now);
+
+	// whether the driver is done with the pending build; without the extension, whether it has
+	// been polled FALLBACK_POLLS times (once per frame from Update, right away from Build), which
+	// counts the poll in the entry
+	bool Finished(Entry& entry);
+
+	// checks the pending build and swaps it in when it linked
+	bool Finish(Entry& entry);
+
+	// takes a linked program object in place of the entry's current one
+	void Swap(Entry& entry, GLuint linked);
+
+	std::vector<Entry> entries;
+	ProgramCache* cache = nullptr;
+	std::function<void(ShaderProgram&)> onLinked;
+	bool parallel = false;
+	bool hotReload = true;
+	double lastCheck = 0.0;
+
+	size_t reloads = 0;
+	size_t failedReloads = 0;
+	double reloadMilliseconds = 0.0;
+};
@@ -0,0 +1,52 @@
+#include <vector>
+
+#include "ShaderProgram.h"
+
+using namespace std;
+
+GLint ShaderProgram::Uniform(const string& name) const
+{
+	auto it = uniforms.find(name);
+	return it == uniforms.end() ? -1 : it->second;
+}
+
+void ShaderProgram::Reflect()
+{
+	uniforms.clear();
+
+	GLint count = 0;
+	GLint maxLength = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+
+	for (GLint i = 0; i < count; ++i)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(id, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+		string uniformName(name.data(), length);
+
+		// arrays are reported as "name[0]"; store them under the plain name as well
+		GLint location = glGetUniformLocation(id, uniformName.c_str());
+		if (location < 0)
+			continue;	// uniform block members have no location
+
+		uniforms[uniformName] = location;
+		size_t bracket = uniformName.find('[');
+		if (bracket != string::npos)
+			uniforms[uniformName.substr(0, bracket)] = location;
+	}
+
+	modelLoc = Uniform("model");
+	uvScaleLoc = Uniform("uvScale");
+	textureArrayLoc = Uniform("textureArray");
+
+	// the per-frame data lives in a uniform buffer shared by every program
+	GLuint frameBlock = glGetUniformBlockIndex(id, "FrameData");
+	if (frameBlock != GL_INVALID_INDEX)
+		glUniformBlockBinding(id, frameBlock, FRAME_DATA_BINDING);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// general includes
+#include <string>
+#include <unordered_map>
+
+// glew includes
+#include <GL/glew.h>
+
+// uniform block binding points shared by every shader program
+enum UniformBlockBinding : GLuint
+{
+	FRAME_DATA_BINDING = 0
+};
+
+// shader storage block binding points shared by every shader program
+enum StorageBlockBinding : GLuint
+{
+	DRAW_DATA_BINDING = 0,
+	LIGHT_DATA_BINDING = 1,		// LightClusters
+	CLUSTER_DATA_BINDING = 2,
+	LIGHT_INDEX_BINDING = 3
+};
+
+// a linked shader program together with its reflected uniform locations,
+// so nothing has to call glGetUniformLocation while a frame is drawn
+struct ShaderProgram
+{
+	GLuint id = 0;
+
+	// every active default-block uniform, looked up once after linking
+	std::unordered_map<std::string, GLint> uniforms;
+
+	// per-draw uniforms, cached separately so the draw loop never hashes a string
+	GLint modelLoc = -1;
+	GLint uvScaleLoc = -1;
+
+	// texture array every draw of the next (multi-)draw samples, see UTextureSlotArray
+	GLint textureArrayLoc = -1;
+
+	// returns -1 when the uniform is not active in the program
+	GLint Uniform(const std::string& name) const;
+
+	// queries the active uniforms and binds the known uniform blocks
+	void Reflect();
+};
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cmath>
+
+// GLM Math Header inclusions
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ShadowMap.h"
+#include "StateCache.h"
+
+using namespace std;
+
+bool UParseShadowPolicy(const string& name, ShadowPolicy& policy)
+{
+	if (name == "off")
+		policy = SHADOW_OFF;
+	else if (name == "cached")
+		policy = SHADOW_CACHED;
+	else if (name == "always")
+		policy = SHADOW_ALWAYS;
+	else
+		return false;
+	return true;
+}
+
+static GLuint UCreateDepthTarget(GLsizei resolution, GLuint& texture)
+{
+	glGenTextures(1, &texture);
+	UStateCache().BindTexture(0, GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, resolution, resolution);
+
+	// hardware comparison, so every PCF tap is already filtered between texels
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	UStateCache().BindTexture(0, GL_TEXTURE_2D, 0);
+
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	UStateCache().BindFramebuffer(framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	return framebuffer;
+}
+
+bool ShadowMap::Create(GLsizei size)
+{
+	resolution = size;
+
+	const GLuint previous = UStateCache().Framebuffer();
+
+	staticFramebuffer = UCreateDepthTarget(resolution, staticDepth);
+	const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	framebuffer = UCreateDepthTarget(resolution, depth);
+	const bool bothComplete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	UStateCache().BindFramebuffer(previous);
+	if (!bothComplete)
+	{
+		Destroy();
+		return false;
+	}
+	return true;
+}
+
+bool ShadowMap::SetLight(const glm::vec3& lightDirection, const BoundingBox& casterArea)
+{
+	const glm::vec3 towardsLight = glm::normalize(lightDirection);
+	if (towardsLight == direction && casterArea.min == area.min && casterArea.max == area.max)
+		return false;
+	direction = towardsLight;
+	area = casterArea;
+
+	// look at the middle of the area from outside it, then fit the box in light space
+	const glm::vec3 center = (area.min + area.max) * 0.5f;
+	const float reach = glm::length(area.max - area.min);
+	const glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	const glm::mat4 view = glm::lookAt(center + direction * reach, center, up);
+
+	const BoundingBox fitted = UTransformBox(area, view);
+	const glm::mat4 projection = glm::ortho(fitted.min.x, fitted.max.x, fitted.min.y, fitted.max.y, -fitted.max.z, -fitted.min.z);
+	viewProjection = projection * view;
+	staticValid = false;
+	return true;
+}
+
+glm::mat4 ShadowMap::ShadowMatrix() const
+{
+	// clip space [-1, 1] to texture space [0, 1]
+	const glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+	return bias * viewProjection;
+}
+
+void ShadowMap::Begin(GLuint target)
+{
+	// the cache knows what to restore, no need to read it back from GL
+	StateCache& state = UStateCache();
+	previousFramebuffer = state.Framebuffer();
+	copy(state.ViewportRect(), state.ViewportRect() + 4, previousViewport);
+
+	state.BindFramebuffer(target);
+	state.Viewport(0, 0, resolution, resolution);
+	state.Enable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(SLOPE_BIAS, CONSTANT_BIAS);
+}
+
+void ShadowMap::BeginStatic()
+{
+	Begin(staticFramebuffer);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	staticValid = true;
+}
+
+void ShadowMap::BeginDynamic()
+{
+	glCopyImageSubData(staticDepth, GL_TEXTURE_2D, 0, 0, 0, 0, depth, GL_TEXTURE_2D, 0, 0, 0, 0, resolution, resolution, 1);
+	Begin(framebuffer);
+}
+
+void ShadowMap::EndPass()
+{
+	UStateCache().Disable(GL_POLYGON_OFFSET_FILL);
+	UStateCache().BindFramebuffer(previousFramebuffer);
+	UStateCache().Viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void ShadowMap::Bind(GLuint unit) const
+{
+	UStateCache().BindTexture(unit, GL_TEXTURE_2D, depth);
+}
+
+void ShadowMap::CountFrame(bool staticRendered, bool dynamicRendered)
+{
+	++frames;
+	staticRenders += staticRendered;
+	dynamicRenders += dynamicRendered;
+}
+
+void ShadowMap::Report(ostream& out) const
+{
+	if (frames == 0)
+		return;
+
+	out << "INFO: Shadow map " << resolution << "x" << resolution << ": static casters rendered in " << staticRenders
+		<< " of " << frames << " frames, " << frames - staticRenders << " frames reused the cached map ("
+		<< 100.0 * (frames - staticRenders) / frames << "%), moving casters composited in " << dynamicRenders << endl;
+}
+
+void ShadowMap::Destroy()
+{
+	glDeleteFramebuffers(1, &staticFramebuffer);
+	glDeleteFramebuffers(1, &framebuffer);
+	UStateCache().DeleteTextures(1, &staticDepth);
+	UStateCache().DeleteTextures(1, &depth);
+	staticFramebuffer = framebuffer = staticDepth = depth = 0;
+	staticValid = false;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+// general includes
+#include <ostream>
+#include <string>
+
+// glew includes
+#include <GL/glew.h>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "TextureArrays.h"
+
+// the shadow map is sampled from the unit after the texture arrays
+constexpr GLuint SHADOW_MAP_UNIT = TEXTURE_ARRAY_UNIT + MAX_TEXTURE_ARRAYS;
+
+// when the shadow map is rendered
+enum ShadowPolicy
+{
+	SHADOW_OFF = 0,		// no shadow pass, the key light reaches everything
+	SHADOW_CACHED,		// static casters only when they or the light change
+	SHADOW_ALWAYS		// everything every frame
+};
+
+// "off", "cached" or "always"
+bool UParseShadowPolicy(const std::string& name, ShadowPolicy& policy);
+
+// depth map of a directional light, kept as two layers: the static casters, rendered only when
+// the cache is stale, and the map the shaders read, which is the static depth with the moving
+// casters drawn over it
+class ShadowMap
+{
+public:
+	bool Create(GLsizei resolution);
+
+	// fits an orthographic light frustum around area, seen from direction (pointing towards the
+	// light); returns true when that changed the light matrix, which makes the cache stale
+	bool SetLight(const glm::vec3& direction, const BoundingBox& area);
+
+	const glm::mat4& ViewProjection() const { return viewProjection; }
+
+	// world position to shadow map texture coordinates and depth
+	glm::mat4 ShadowMatrix() const;
+
+	// targets the static layer and clears it; the caller draws the static casters
+	void BeginStatic();
+
+	// copies the static layer into the sampled one and targets it for the moving casters
+	void BeginDynamic();
+
+	// back to the framebuffer and viewport that were bound before Begin*
+	void EndPass();
+
+	void Invalidate() { staticValid = false; }
+	bool StaticValid() const { return staticValid; }
+
+	void Bind(GLuint unit) const;
+
+	GLsizei Resolution() const { return resolution; }
+
+	// one call per frame with what was rendered, for the reuse statistics
+	void CountFrame(bool staticRendered, bool dynamicRendered);
+	void Report(std::ostream& out) const;
+
+	void Destroy();
+
+private:
+	// pixels of depth slope scale and constant bias, against acne on lit surfaces
+	static constexpr float SLOPE_BIAS = 2.0f;
+	static constexpr float CONSTANT_BIAS = 4.0f;
+
+	void Begin(GLuint framebuffer);
+
+	GLsizei resolution = 0;
+	GLuint staticDepth = 0;
+	GLuint depth = 0;
+	GLuint staticFramebuffer = 0;
+	GLuint framebuffer = 0;
+
+	glm::vec3 direction = glm::vec3(0.0f);
+	BoundingBox area;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	bool staticValid = false;
+
+	// state to restore after a pass
+	GLuint previousFramebuffer = 0;
+	GLint previousViewport[4] = {};
+
+	size_t frames = 0;
+	size_t staticRenders = 0;
+	size_t dynamicRenders = 0;
+};
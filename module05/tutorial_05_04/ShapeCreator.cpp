@@ -6,11 +6,51 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 #include <cmath>
+#include <string>
 
 #include "ShapeCreator.h"
+#include "MeshIndexer.h"
+#include "Transform.h"
 
 using namespace std;
 
+namespace
+{
+// cos and sin of every sector edge, i * 2pi / sides for i = 0..sides + 1, so each angle is
+// evaluated once instead of once per vertex that uses it
+void USectorTables(float sides, vector<float>& cosines, vector<float>& sines)
+{
+	constexpr float PI = 3.14159265f;
+	const float sectorStep = 2.0f * PI / sides;
+
+	const int count = (int)sides + 2;
+	cosines.resize(count);
+	sines.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		cosines[i] = cos(i * sectorStep);
+		sines[i] = sin(i * sectorStep);
+	}
+}
+
+// writes one interleaved vertex (position, color, uv) and returns where the next one goes
+inline float* UPutVertex(float* out, float x, float y, float z, const float* c, float u, float v)
+{
+	out[0] = x;	out[1] = y;	out[2] = z;	out[3] = c[0];
+	out[4] = c[1];	out[5] = c[2];	out[6] = c[3];	out[7] = u;
+	out[8] = v;
+	return out + GeometryPool::FLOATS_PER_VERTEX;
+}
+}
+
+GeometryPool ShapeCreator::geometry;
+thread_local vector<ShapeCreator::PendingGeometry>* ShapeCreator::pending = nullptr;
+
+GeometryPool& ShapeCreator::UGeometry()
+{
+	return geometry;
+}
+
 /// taken from github. I could not figure out how to make cylinders or make shapes separately for one scene.
 
 void ShapeCreator::UBuildPyramid(GLMesh& mesh)
@@ -19,7 +59,7 @@ void ShapeCreator::UBuildPyramid(GLMesh& mesh)
 
 	float h = mesh.height;
 
-
+	mesh.shape = "pyramid";
 	mesh.v = {
 		// Vertex Positions    // normals						// Texture coords
 		 0.0f,	h,		0.0f,	0.0f,	1.0f,	-1.0f,	1.0f,	0.625f, 1.0f,		//back side
@@ -54,6 +94,7 @@ void ShapeCreator::UBuildCube(GLMesh& mesh)
 {
 	vector<float> c = { mesh.p[0], mesh.p[1], mesh.p[2], mesh.p[3] };
 
+	mesh.shape = "cube";
 	mesh.v = {
 		0.5f,	0.0f,	0.5f,	0.0f,	0.0f,	1.0f,	1.0f,	0.25f,	0.5f,	// front left
 		-0.5f,	0.0f,	0.5f,	0.0f,	0.0f,	1.0f,	1.0f,	0.0f,	0.5f,
@@ -116,123 +157,95 @@ void ShapeCreator::UBuildCube(GLMesh& mesh)
 
 void ShapeCreator::UBuildCone(GLMesh& mesh)
 {
-	vector<float> c = { mesh.p[0], mesh.p[1], mesh.p[2], mesh.p[3] };
+	mesh.shape = "cone";
+	mesh.v = UConeVertices(mesh, mesh.number_of_sides);
+	UTranslator(mesh);
+	UBuildLods(mesh, UConeVertices);
+}
+
+vector<float> ShapeCreator::UConeVertices(const GLMesh& mesh, float s)
+{
+	const float c[4] = { mesh.p[0], mesh.p[1], mesh.p[2], mesh.p[3] };
 
 	float r = mesh.radius;
 	float l = mesh.length;
-	float s = mesh.number_of_sides;
 
-	constexpr float PI = 3.14159265f;
-	const float sectorStep = 2.0f * PI / s;
 	const float textStep = 1.0f / s;
 	float textureXLoc = 0.0f;
 
-	vector<float> v;
-
-	for (auto i = 1; i < s + 1; i++) {
+	// every sector reads the angles of both of its edges
+	vector<float> cosines, sines;
+	USectorTables(s, cosines, sines);
 
+	// six vertices per sector: a bottom fan triangle and a side triangle up to the peak
+	const int sectors = (int)s;
+	vector<float> v(sectors * 6 * GeometryPool::FLOATS_PER_VERTEX);
+	float* out = v.data();
+	for (auto i = 1; i < sectors + 1; i++)
+	{
+		const float x0 = 0.5f + r * cosines[i], y0 = 0.5f + r * sines[i];
+		const float x1 = 0.5f + r * cosines[i + 1], y1 = 0.5f + r * sines[i + 1];
 
-		// triangle fan, bottom
-		v.insert(v.end(), { 0.5f, 0.5f, 0.0f, c[0], c[1], c[2], c[3], 0.5f, 0.25f });		// center point; x, y, z, r, g, b, a, texture x, texture y
-		v.insert(v.end(), { 0.5f + r * cos(i * sectorStep) ,
-										0.5f + r * sin(i * sectorStep) ,
-										0.0f ,
-										c[0], c[1], c[2], c[3],
-			/*textureXLoc,
-			0.0f*/
-			0.5f + (r * cos((i)*sectorStep)) ,			// texture x; adding the origin for proper alignment
-			0.25f + (0.25f * sin((i)*sectorStep))
-			});												// first outer point
-		v.insert(v.end(), { 0.5f + (r * cos((i + 1) * sectorStep)) ,
-										0.5f + (r * sin((i + 1) * sectorStep)) ,
-										0.0f ,
-										c[0], c[1], c[2], c[3],
-			/*textureXLoc + textStep,
-			0.0f*/
-			0.5f + (r * cos((i + 1) * sectorStep)) ,
-			0.25f + (0.25f * sin((i + 1) * sectorStep))
-			});												// second outer point
-
+		// triangle fan, bottom; the texture is centered on the origin
+		out = UPutVertex(out, 0.5f, 0.5f, 0.0f, c, 0.5f, 0.25f);
+		out = UPutVertex(out, x0, y0, 0.0f, c, x0, 0.25f + (0.25f * sines[i]));
+		out = UPutVertex(out, x1, y1, 0.0f, c, x1, 0.25f + (0.25f * sines[i + 1]));
 
-// side triangle + point
-		v.insert(v.end(), { 0.5f + (r * cos(i * sectorStep)) ,
-										0.5f + (r * sin(i * sectorStep)) ,
-										0.0f ,
-										c[0], c[1], c[2], c[3],
-										textureXLoc ,
-										0.5f });
-		v.insert(v.end(), { 0.5f + (r * cos((i + 1) * sectorStep)) ,
-										0.5f + (r * sin((i + 1) * sectorStep)) ,
-										0.0f ,
-										c[0], c[1], c[2], c[3],
-										textureXLoc + textStep,
-										0.5f });
-		v.insert(v.end(), { 0.5f , 0.5f , l , c[0], c[1], c[2], c[3], textureXLoc + (textStep / 2), 1.0f });		// origin, peak
+		// side triangle + point
+		out = UPutVertex(out, x0, y0, 0.0f, c, textureXLoc, 0.5f);
+		out = UPutVertex(out, x1, y1, 0.0f, c, textureXLoc + textStep, 0.5f);
+		out = UPutVertex(out, 0.5f, 0.5f, l, c, textureXLoc + (textStep / 2), 1.0f);		// origin, peak
 
 		textureXLoc += textStep;
-
 	}
 
-	mesh.v = v;
-	v.clear();	// clear the local vector
-
-	UTranslator(mesh);
+	return v;
 }
 
 
 void ShapeCreator::UBuildCylinder(GLMesh& mesh)
 {
-	vector<float> c = { mesh.p[0], mesh.p[1], mesh.p[2], mesh.p[3] };
+	mesh.shape = "cylinder";
+	mesh.v = UCylinderVertices(mesh, mesh.number_of_sides);
+	UTranslator(mesh);
+	UBuildLods(mesh, UCylinderVertices);
+}
+
+vector<float> ShapeCreator::UCylinderVertices(const GLMesh& mesh, float s)
+{
+	const float c[4] = { mesh.p[0], mesh.p[1], mesh.p[2], mesh.p[3] };
 
 	float r = mesh.radius;
 	float l = mesh.length;
-	float s = mesh.number_of_sides;
-	float h = mesh.height;
 
+	vector<float> cosines, sines;
+	USectorTables(s, cosines, sines);
 
-	constexpr float PI = 3.14159265f;
-	const float sectorStep = 2.0f * PI / s;
+	// twelve vertices per sector: one triangle in each fan and two on the side
+	const int sectors = (int)s;
+	vector<float> v(sectors * 12 * GeometryPool::FLOATS_PER_VERTEX);
+	float* out = v.data();
 
-	vector<float> v;
-
-	for (auto i = 1; i < s + 1; i++)
+	// triangle fan, bottom; origin (0.5, 0.5) works best for textures
+	for (auto i = 1; i < sectors + 1; i++)
 	{
-		// triangle fan, bottom
-		v.insert(v.end(), { 0.5f, 0.5f, 0.0f, c[0],	c[1], c[2],	c[3], 0.5f, 0.125f });			// origin (0.5, 0.5) works best for textures
-		v.insert(v.end(), { 0.5f + r * cos(i * sectorStep) ,			// x
-										0.5f + r * sin(i * sectorStep) ,			// y
-										0.0f ,										// z
-										c[0], c[1], c[2], c[3],						// color data r g b a
-										0.5f + (r * cos((i)*sectorStep)) ,		// texture x; adding the origin for proper alignment
-										(0.125f + (0.125f * sin((i)*sectorStep))) });		// texture y
-
-
-		v.insert(v.end(), { 0.5f + r * cos((i + 1) * sectorStep) ,
-										0.5f + r * sin((i + 1) * sectorStep) ,
-										0.0f ,
-										c[0], c[1], c[2], c[3],						// color data r g b a
-										0.5f + (r * cos((i + 1) * sectorStep)) ,
-										(0.125f + (0.125f * sin((i + 1) * sectorStep))) });
-
+		const float x0 = 0.5f + r * cosines[i], y0 = 0.5f + r * sines[i];
+		const float x1 = 0.5f + r * cosines[i + 1], y1 = 0.5f + r * sines[i + 1];
 
+		out = UPutVertex(out, 0.5f, 0.5f, 0.0f, c, 0.5f, 0.125f);
+		out = UPutVertex(out, x0, y0, 0.0f, c, x0, (0.125f + (0.125f * sines[i])));
+		out = UPutVertex(out, x1, y1, 0.0f, c, x1, (0.125f + (0.125f * sines[i + 1])));
 	}
 
-	for (auto i = 1; i < s + 1; i++)
+	// triangle fan, top; built the 'l' value away from the other fan
+	for (auto i = 1; i < sectors + 1; i++)
 	{
-		// triangle fan, top
-		v.insert(v.end(), { 0.5f, 0.5f, l, c[0], c[1], c[2], c[3], 0.5f, 0.875f });			// origin (0.5, 0.5) works best for textures
-		v.insert(v.end(), { 0.5f + r * cos(i * sectorStep) ,
-										0.5f + r * sin(i * sectorStep) ,
-										l ,										// build this fan the 'l' value away from the other fan
-										c[0], c[1], c[2], c[3],					// color data r g b a
-										0.5f + (r * cos((i)*sectorStep)) ,
-										0.875f + (0.125f * sin((i)*sectorStep)) });
-		v.insert(v.end(), { 0.5f + r * cos((i + 1) * sectorStep) ,
-										0.5f + r * sin((i + 1) * sectorStep) ,
-										l ,
-										c[0], c[1], c[2], c[3],					// color data r g b a
-										0.5f + (r * cos((i + 1) * sectorStep)) ,
-										0.875f + (0.125f * sin((i + 1) * sectorStep)) });
+		const float x0 = 0.5f + r * cosines[i], y0 = 0.5f + r * sines[i];
+		const float x1 = 0.5f + r * cosines[i + 1], y1 = 0.5f + r * sines[i + 1];
+
+		out = UPutVertex(out, 0.5f, 0.5f, l, c, 0.5f, 0.875f);
+		out = UPutVertex(out, x0, y0, l, c, x0, 0.875f + (0.125f * sines[i]));
+		out = UPutVertex(out, x1, y1, l, c, x1, 0.875f + (0.125f * sines[i + 1]));
 	}
 
 	// since all side triangles have the same points as the fans above, the same calculations are used
@@ -243,52 +256,22 @@ void ShapeCreator::UBuildCylinder(GLMesh& mesh)
 	float k = 0.0f;				// for texture clamping
 
 	// sides
-	for (auto i = 1; i < s + 1; i++)
+	for (auto i = 1; i < sectors + 1; i++)
 	{
-		v.insert(v.end(), { 0.5f + r * cos(i * sectorStep) ,
-										0.5f + r * sin(i * sectorStep) ,
-										0.0f ,
-										c[0], c[1], c[2], c[3],					// color data r g b a
-										k ,
-										0.25f });
-		v.insert(v.end(), { 0.5f + r * cos(i * sectorStep) ,
-										0.5f + r * sin(i * sectorStep) ,
-										l ,
-										c[0], c[1], c[2], c[3],					// color data r g b a
-										k ,
-										0.75f });
-		v.insert(v.end(), { 0.5f + r * cos((i + 1) * sectorStep) ,
-										0.5f + r * sin((i + 1) * sectorStep) ,
-										l ,
-										c[0], c[1], c[2], c[3],					// color data r g b a
-										k + j ,
-										0.75f });
+		const float x0 = 0.5f + r * cosines[i], y0 = 0.5f + r * sines[i];
+		const float x1 = 0.5f + r * cosines[i + 1], y1 = 0.5f + r * sines[i + 1];
 
-		v.insert(v.end(), { 0.5f + r * cos((i + 1) * sectorStep) ,
-										0.5f + r * sin((i + 1) * sectorStep) ,
-										l ,
-										c[0], c[1], c[2], c[3],					// color data r g b a
-										k + j ,
-										0.75f });
-		v.insert(v.end(), { 0.5f + r * cos((i + 1) * sectorStep) ,
-										0.5f + r * sin((i + 1) * sectorStep) ,
-										0.0f ,
-										c[0], c[1], c[2], c[3],					// color data r g b a
-										k + j ,
-										0.25f });
-		v.insert(v.end(), { 0.5f + r * cos(i * sectorStep) ,
-										0.5f + r * sin(i * sectorStep) ,
-										0.0f ,
-										c[0], c[1], c[2], c[3],					// color data r g b a
-										k,
-										0.25f });
+		out = UPutVertex(out, x0, y0, 0.0f, c, k, 0.25f);
+		out = UPutVertex(out, x0, y0, l, c, k, 0.75f);
+		out = UPutVertex(out, x1, y1, l, c, k + j, 0.75f);
+
+		out = UPutVertex(out, x1, y1, l, c, k + j, 0.75f);
+		out = UPutVertex(out, x1, y1, 0.0f, c, k + j, 0.25f);
+		out = UPutVertex(out, x0, y0, 0.0f, c, k, 0.25f);
 		k += j;
 	}
 
-	mesh.v = v;
-	v.clear();
-	UTranslator(mesh);
-
+	return v;
 }
 
 
@@ -296,6 +279,7 @@ void ShapeCreator::UBuildPlane(GLMesh& mesh)
 {
 	// Use this to build the ground, for proper lighting
 	vector<float> c = { mesh.p[0], mesh.p[1], mesh.p[2], mesh.p[3] };
+	mesh.shape = "plane";
 	mesh.v = {
 		-1.0f, 0.0f, -1.0f, c[0], c[1], c[2], c[3], 0.0f, 1.0f,	// 0
 		 0.0f, 0.0f, 1.0f, c[0], c[1], c[2], c[3], 0.5f, 0.0f,	// 1
@@ -354,6 +338,7 @@ void ShapeCreator::UBuildCircle(GLMesh& mesh)
 
 	vector<float> v;
 
+	mesh.shape = "circle";
 	for (auto i = 1; i < s + 1; i++)
 	{
 		// triangle fan
@@ -387,38 +372,33 @@ void ShapeCreator::UTranslator(GLMesh& mesh)
 	constexpr GLuint floatsPerColor = 4;
 	constexpr GLuint floatsPerUV = 2;
 
-	mesh.nIndices = mesh.v.size() / (floatsPerVertex + floatsPerUV + floatsPerColor);
+	constexpr GLuint floatsPerTotal = floatsPerVertex + floatsPerUV + floatsPerColor;
 
-	glGenVertexArrays(1, &mesh.vao);
-	glBindVertexArray(mesh.vao);
+	// local bounds straight from the generated vertices, before they are welded away
+	UComputeBounds(mesh.v, floatsPerTotal, mesh.localBox, mesh.localSphere);
 
-	// Create VBO
-	glGenBuffers(1, &mesh.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
+	// weld the triangle soup into unique vertices plus an index list ordered for the post-transform cache
+	vector<float> vertices;
+	vector<GLuint> indices;
+	MeshIndexer::UIndex(mesh.shape, mesh.v, floatsPerTotal, vertices, indices);
 
-	// use vector instead of array
-	glBufferData(
-		GL_ARRAY_BUFFER,
-		mesh.v.size() * sizeof(float),
-		&mesh.v.front(),
-		GL_STATIC_DRAW
-	); // Sends vertex or coordinate data to the GPU
+	// the soup is in the pool now; coarser levels are generated again from the shape properties
+	vector<float>().swap(mesh.v);
 
-	// Strides between vertex coordinates
-	constexpr GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV + floatsPerColor);
+	static_assert(floatsPerTotal == GeometryPool::FLOATS_PER_VERTEX, "vertex layout must match the geometry pool");
 
-	// Create Vertex Attribute Pointers
-	// location
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
+	// suballocate the mesh from the shared buffers; the pool uploads everything in one go on Commit
+	const GeometryRange range = UAddGeometry(0, vertices, indices);
 
-	// color
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+	mesh.firstIndex = range.firstIndex;
+	mesh.baseVertex = range.baseVertex;
+	mesh.nVertices = range.vertexCount;
+	mesh.nIndices = range.indexCount;
 
-	// texture
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(7 * sizeof(float)));
-	glEnableVertexAttribArray(2);
+	// the shape as built is the finest level; exact shapes have no other
+	mesh.lods.assign(1, LodLevel());
+	mesh.lods[0].range = range;
+	mesh.lods[0].sides = 0;
 
 
 	// scale the object
@@ -436,9 +416,82 @@ void ShapeCreator::UTranslator(GLMesh& mesh)
 	mesh.translation = glm::translate(glm::vec3(mesh.p[19], mesh.p[20], mesh.p[21]));
 
 	mesh.model = mesh.translation * mesh.xrotation * mesh.zrotation * mesh.yrotation * mesh.scale;
+	mesh.normalMatrix = UNormalMatrix(mesh.model);
+	mesh.worldBox = UTransformBox(mesh.localBox, mesh.model);
+	mesh.worldSphere = UTransformSphere(mesh.localSphere, mesh.model);
 
 	mesh.gUVScale = glm::vec2(mesh.p[22], mesh.p[23]);		// scales the texture
 	//mesh.gUVScale = glm::vec2(2.0f, 2.0f);		// scales the texture
 
 }
 
+void ShapeCreator::UBuildLods(GLMesh& mesh, vector<float> (*buildVertices)(const GLMesh&, float))
+{
+	constexpr GLuint floatsPerTotal = GeometryPool::FLOATS_PER_VERTEX;
+
+	const string lodShape = string(mesh.shape) + " lod";
+
+	mesh.lods[0].sides = (GLuint)mesh.number_of_sides;
+	for (GLuint sides : LOD_SIDES)
+	{
+		if (sides >= mesh.lods.back().sides)
+			continue;
+
+		// the polygons of coarser levels sit inside the finest one, so its bounds cover them too;
+		// their stats go under a key of their own so they do not skew the authored meshes'
+		vector<float> vertices;
+		vector<GLuint> indices;
+		MeshIndexer::UIndex(lodShape.c_str(), buildVertices(mesh, (float)sides), floatsPerTotal, vertices, indices);
+
+		LodLevel level;
+		level.range = UAddGeometry(mesh.lods.size(), vertices, indices);
+		level.sides = sides;
+		mesh.lods.push_back(level);
+	}
+}
+
+GeometryRange ShapeCreator::UAddGeometry(size_t level, vector<float>& vertices, vector<GLuint>& indices)
+{
+	if (!pending)
+		return geometry.Add(vertices, indices);
+
+	PendingGeometry held;
+	held.level = level;
+	held.vertices.swap(vertices);
+	held.indices.swap(indices);
+	pending->push_back(move(held));
+	return GeometryRange();
+}
+
+void ShapeCreator::UBuildParallel(const vector<pair<GLMesh*, Builder>>& jobs, ThreadPool& workers)
+{
+	vector<vector<PendingGeometry>> results(jobs.size());
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		workers.Submit([&jobs, &results, i]()
+		{
+			pending = &results[i];
+			jobs[i].second(*jobs[i].first);
+			pending = nullptr;
+		});
+	}
+	workers.Wait();
+
+	// the pool is not thread safe, and adding in job order keeps its layout deterministic
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		GLMesh& mesh = *jobs[i].first;
+		for (auto& held : results[i])
+		{
+			const GeometryRange range = geometry.Add(held.vertices, held.indices);
+			mesh.lods[held.level].range = range;
+			if (held.level == 0)
+			{
+				mesh.firstIndex = range.firstIndex;
+				mesh.baseVertex = range.baseVertex;
+				mesh.nVertices = range.vertexCount;
+				mesh.nIndices = range.indexCount;
+			}
+		}
+	}
+}
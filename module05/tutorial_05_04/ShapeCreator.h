@@ -1,6 +1,10 @@
 #pragma once
 
+#include <utility>
+
 #include "Mesh.h"
+#include "GeometryPool.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
@@ -26,4 +30,39 @@ public:
 
 	static void UTranslator(GLMesh& mesh);
 
+	// triangle soups of the round shapes for a given number of sides, without building a mesh
+	static vector<float> UConeVertices(const GLMesh& mesh, float sides);
+	static vector<float> UCylinderVertices(const GLMesh& mesh, float sides);
+
+	// one of the UBuild functions above
+	typedef void (*Builder)(GLMesh& mesh);
+
+	// runs every builder on the workers (vertex generation, welding, bounds), then adds the
+	// geometry to the pool in the order given, so the layout matches a serial build
+	static void UBuildParallel(const vector<pair<GLMesh*, Builder>>& jobs, ThreadPool& workers);
+
+	// every mesh built by UTranslator is suballocated from this pool
+	static GeometryPool& UGeometry();
+
+private:
+	static GeometryPool geometry;
+
+	// geometry of a mesh held back while a worker builds it; level 0 is the mesh itself
+	struct PendingGeometry
+	{
+		size_t level;
+		vector<float> vertices;
+		vector<GLuint> indices;
+	};
+
+	// set on a worker for the duration of one UBuildParallel job
+	static thread_local vector<PendingGeometry>* pending;
+
+	// adds to the pool right away, or to pending on a worker (the range is filled in later)
+	static GeometryRange UAddGeometry(size_t level, vector<float>& vertices, vector<GLuint>& indices);
+
+
+	// adds a coarser copy of a round shape for every LOD_SIDES entry below its number_of_sides
+	static void UBuildLods(GLMesh& mesh, vector<float> (*buildVertices)(const GLMesh&, float));
+
 };
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include <algorithm>
+
+#include "StateCache.h"
+
+using namespace std;
+
+constexpr GLenum StateCache::CAPABILITIES[];
+constexpr GLuint StateCache::UNKNOWN;
+
+StateCache& UStateCache()
+{
+	static StateCache cache;
+	return cache;
+}
+
+StateCache::StateCache()
+{
+	ForgetBindings();
+}
+
+void StateCache::ForgetBindings()
+{
+	activeUnit = UNKNOWN;
+	fill(begin(textures2D), end(textures2D), UNKNOWN);
+	fill(begin(textureArrays), end(textureArrays), UNKNOWN);
+	fill(begin(samplers), end(samplers), UNKNOWN);
+}
+
+void StateCache::Sync()
+{
+	GLint value = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+	program = (GLuint)value;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+	vertexArray = (GLuint)value;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &value);
+	framebuffer = (GLuint)value;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DEPTH_FUNC, &value);
+	depthFunc = (GLenum)value;
+
+	GLboolean mask[4] = {};
+	glGetBooleanv(GL_DEPTH_WRITEMASK, mask);
+	depthMask = mask[0];
+	glGetBooleanv(GL_COLOR_WRITEMASK, mask);
+	colorMask = mask[0] && mask[1] && mask[2] && mask[3] ? GL_TRUE : (!mask[0] && !mask[1] && !mask[2] && !mask[3] ? GL_FALSE : -1);
+
+	for (size_t i = 0; i < CAPABILITY_COUNT; ++i)
+		capabilities[i] = glIsEnabled(CAPABILITIES[i]);
+
+	ForgetBindings();
+}
+
+bool StateCache::Changes(StateKind kind, bool changed)
+{
+	if (changed)
+		++issued[kind];
+	else
+		++skipped[kind];
+	return changed;
+}
+
+void StateCache::SetCapability(GLenum capability, bool enabled)
+{
+	const size_t i = find(begin(CAPABILITIES), end(CAPABILITIES), capability) - begin(CAPABILITIES);
+	if (i < CAPABILITY_COUNT)
+	{
+		if (!Changes(STATE_FIXED, capabilities[i] != (GLint)enabled))
+			return;
+		capabilities[i] = enabled;
+	}
+	else
+		Changes(STATE_FIXED, true);
+
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+void StateCache::Enable(GLenum capability)
+{
+	SetCapability(capability, true);
+}
+
+void StateCache::Disable(GLenum capability)
+{
+	SetCapability(capability, false);
+}
+
+void StateCache::DepthFunc(GLenum function)
+{
+	if (!Changes(STATE_FIXED, depthFunc != function))
+		return;
+	depthFunc = function;
+	glDepthFunc(function);
+}
+
+void StateCache::DepthMask(GLboolean write)
+{
+	if (!Changes(STATE_FIXED, depthMask != write))
+		return;
+	depthMask = write;
+	glDepthMask(write);
+}
+
+void StateCache::ColorMask(GLboolean write)
+{
+	if (!Changes(STATE_FIXED, colorMask != write))
+		return;
+	colorMask = write;
+	glColorMask(write, write, write, write);
+}
+
+void StateCache::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (!Changes(STATE_FIXED, viewport[0] != x || viewport[1] != y || viewport[2] != width || viewport[3] != height))
+		return;
+	viewport[0] = x;
+	viewport[1] = y;
+	viewport[2] = width;
+	viewport[3] = height;
+	glViewport(x, y, width, height);
+}
+
+void StateCache::BindFramebuffer(GLuint target)
+{
+	if (!Changes(STATE_FIXED, framebuffer != target))
+		return;
+	framebuffer = target;
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+void StateCache::UseProgram(GLuint id)
+{
+	if (!Changes(STATE_PROGRAM, program != id))
+		return;
+	program = id;
+	glUseProgram(id);
+}
+
+void StateCache::BindVertexArray(GLuint id)
+{
+	if (!Changes(STATE_VERTEX_ARRAY, vertexArray != id))
+		return;
+	vertexArray = id;
+	glBindVertexArray(id);
+}
+
+void StateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	GLuint* bound = nullptr;
+	if (unit < MAX_TEXTURE_UNITS)
+		bound = target == GL_TEXTURE_2D_ARRAY ? &textureArrays[unit] : &textures2D[unit];
+	if (!Changes(STATE_TEXTURE, !bound || *bound != texture))
+		return;
+	if (bound)
+		*bound = texture;
+
+	if (Changes(STATE_TEXTURE, activeUnit != unit))
+	{
+		activeUnit = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+	glBindTexture(target, texture);
+}
+
+void StateCache::BindSampler(GLuint unit, GLuint sampler)
+{
+	GLuint* bound = unit < MAX_TEXTURE_UNITS ? &samplers[unit] : nullptr;
+	if (!Changes(STATE_SAMPLER, !bound || *bound != sampler))
+		return;
+	if (bound)
+		*bound = sampler;
+	glBindSampler(unit, sampler);
+}
+
+void StateCache::DeleteTextures(GLsizei count, const GLuint* textures)
+{
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (textures[i] == 0)
+			continue;
+		for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; ++unit)
+		{
+			if (textures2D[unit] == textures[i])
+				textures2D[unit] = 0;
+			if (textureArrays[unit] == textures[i])
+				textureArrays[unit] = 0;
+		}
+	}
+	glDeleteTextures(count, textures);
+}
+
+void StateCache::EndFrame()
+{
+	for (size_t kind = 0; kind < STATE_KIND_COUNT; ++kind)
+	{
+		totalIssued[kind] += issued[kind];
+		totalSkipped[kind] += skipped[kind];
+		issued[kind] = skipped[kind] = 0;
+	}
+	++frames;
+}
+
+void StateCache::Report(ostream& out) const
+{
+	if (frames == 0)
+		return;
+
+	static const char* const names[STATE_KIND_COUNT] = { "programs", "vertex arrays", "textures", "samplers", "fixed function" };
+	size_t allIssued = 0;
+	size_t allSkipped = 0;
+	for (size_t kind = 0; kind < STATE_KIND_COUNT; ++kind)
+	{
+		allIssued += totalIssued[kind];
+		allSkipped += totalSkipped[kind];
+	}
+
+	out << "INFO: GL state per frame: " << (double)allIssued / frames << " calls issued, " << (double)allSkipped / frames
+		<< " redundant ones skipped (";
+	for (size_t kind = 0; kind < STATE_KIND_COUNT; ++kind)
+	{
+		out << (kind ? ", " : "") << names[kind] << " " << (double)totalIssued[kind] / frames << "/"
+			<< (double)totalSkipped[kind] / frames;
+	}
+	out << " issued/skipped)" << endl;
+}
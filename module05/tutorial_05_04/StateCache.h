@@ -0,0 +1,105 @@
+#pragma once
+
+// general includes
+#include <cstddef>
+#include <ostream>
+
+// glew includes
+#include <GL/glew.h>
+
+// kinds of state the cache counts separately
+enum StateKind
+{
+	STATE_PROGRAM = 0,
+	STATE_VERTEX_ARRAY,
+	STATE_TEXTURE,		// texture bindings and the active unit
+	STATE_SAMPLER,
+	STATE_FIXED,		// capabilities, depth and color masks, depth function, framebuffer, viewport
+	STATE_KIND_COUNT
+};
+
+// shadow of the GL state the renderer changes, so a call that would set what is already set is
+// never issued. Only sees what goes through it: after GL calls behind its back Sync re-reads the
+// state before the next change. Textures are deleted through it, since their names come back
+class StateCache
+{
+public:
+	// texture units the cache tracks; binds to later units go straight through
+	static constexpr GLuint MAX_TEXTURE_UNITS = 16;
+
+	StateCache();
+
+	// reads back program, vertex array, framebuffer, viewport and the fixed function state, and
+	// forgets the texture and sampler bindings; needs a current context
+	void Sync();
+
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void DepthFunc(GLenum function);
+	void DepthMask(GLboolean write);
+	void ColorMask(GLboolean write);	// all four channels
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void BindFramebuffer(GLuint framebuffer);
+
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vertexArray);
+
+	// selects the unit only when the binding actually changes; target is GL_TEXTURE_2D or
+	// GL_TEXTURE_2D_ARRAY
+	void BindTexture(GLuint unit, GLenum target, GLuint texture);
+	void BindSampler(GLuint unit, GLuint sampler);
+
+	// glDeleteTextures, and every unit that held one of them is known to be bound to 0 again, as
+	// GL leaves it; otherwise a new texture with a recycled name would look bound already
+	void DeleteTextures(GLsizei count, const GLuint* textures);
+
+	// what the cache knows is bound, for code that has to put state back
+	GLuint Framebuffer() const { return framebuffer; }
+	const GLint* ViewportRect() const { return viewport; }
+
+	// closes the counters of one frame
+	void EndFrame();
+
+	// calls issued and dropped, per frame on average, by kind
+	void Report(std::ostream& out) const;
+
+private:
+	// capabilities the cache shadows, in this order
+	static constexpr GLenum CAPABILITIES[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_POLYGON_OFFSET_FILL };
+	static constexpr size_t CAPABILITY_COUNT = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+	// sentinel for a binding the cache does not know
+	static constexpr GLuint UNKNOWN = ~0u;
+
+	void SetCapability(GLenum capability, bool enabled);
+
+	// marks every texture and sampler binding unknown
+	void ForgetBindings();
+
+	// counts the call and returns whether it has to be issued
+	bool Changes(StateKind kind, bool changed);
+
+	GLuint program = UNKNOWN;
+	GLuint vertexArray = UNKNOWN;
+	GLuint framebuffer = UNKNOWN;
+	GLint viewport[4] = { -1, -1, -1, -1 };
+	GLenum depthFunc = GL_NONE;
+	GLint depthMask = -1;
+	GLint colorMask = -1;
+	GLint capabilities[CAPABILITY_COUNT] = { -1, -1, -1, -1 };
+
+	GLuint activeUnit = UNKNOWN;
+	GLuint textures2D[MAX_TEXTURE_UNITS];
+	GLuint textureArrays[MAX_TEXTURE_UNITS];
+	GLuint samplers[MAX_TEXTURE_UNITS];
+
+	// calls of the current frame, and the sums of the finished ones
+	size_t issued[STATE_KIND_COUNT] = {};
+	size_t skipped[STATE_KIND_COUNT] = {};
+	size_t totalIssued[STATE_KIND_COUNT] = {};
+	size_t totalSkipped[STATE_KIND_COUNT] = {};
+	size_t frames = 0;
+};
+
+// the one cache of the context, shared by everything that changes GL state
+StateCache& UStateCache();
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <iostream>
+
+#include "TextureArrays.h"
+#include "StateCache.h"
+
+using namespace std;
+
+bool TextureArraySet::Build(const vector<GLuint>& textures)
+{
+	Destroy();
+
+	// group the textures by the size and format of their top level
+	for (GLuint texture : textures)
+	{
+		if (texture == 0 || slots.count(texture))
+			continue;
+
+		GLint width = 0, height = 0, format = 0;
+		UStateCache().BindTexture(0, GL_TEXTURE_2D, texture);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+
+		auto match = find_if(arrays.begin(), arrays.end(), [&](const Array& a) {
+			return a.width == width && a.height == height && a.format == format;
+		});
+		if (match == arrays.end())
+		{
+			if (arrays.size() == MAX_TEXTURE_ARRAYS)
+			{
+				cout << "ERROR: more than " << MAX_TEXTURE_ARRAYS << " texture sizes/formats for the texture arrays" << endl;
+				UStateCache().BindTexture(0, GL_TEXTURE_2D, 0);
+				Destroy();
+				return false;
+			}
+			arrays.push_back({ width, height, format, {}, 0 });
+			match = arrays.end() - 1;
+		}
+
+		slots[texture] = UTextureSlot((GLuint)(match - arrays.begin()), (GLuint)match->sources.size());
+		match->sources.push_back(texture);
+	}
+	UStateCache().BindTexture(0, GL_TEXTURE_2D, 0);
+
+	// one immutable array per group, filled level by level straight from the 2D textures
+	for (Array& a : arrays)
+	{
+		GLsizei levels = 1;
+		while ((max(a.width, a.height) >> levels) > 0)
+			++levels;
+
+		glGenTextures(1, &a.id);
+		UStateCache().BindTexture(0, GL_TEXTURE_2D_ARRAY, a.id);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, a.format, a.width, a.height, (GLsizei)a.sources.size());
+
+		// same sampling as the 2D textures
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		for (GLsizei layer = 0; layer < (GLsizei)a.sources.size(); ++layer)
+		{
+			for (GLint level = 0; level < levels; ++level)
+			{
+				glCopyImageSubData(a.sources[layer], GL_TEXTURE_2D, level, 0, 0, 0,
+					a.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+					max(1, a.width >> level), max(1, a.height >> level), 1);
+			}
+		}
+	}
+	UStateCache().BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+	return true;
+}
+
+GLuint TextureArraySet::Slot(GLuint textureId) const
+{
+	auto slot = slots.find(textureId);
+	return slot == slots.end() ? 0 : slot->second;
+}
+
+void TextureArraySet::Bind() const
+{
+	for (size_t i = 0; i < arrays.size(); ++i)
+		UStateCache().BindTexture(TEXTURE_ARRAY_UNIT + (GLuint)i, GL_TEXTURE_2D_ARRAY, arrays[i].id);
+}
+
+void TextureArraySet::Destroy()
+{
+	for (Array& a : arrays)
+		UStateCache().DeleteTextures(1, &a.id);
+	arrays.clear();
+	slots.clear();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// general includes
+#include <unordered_map>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// arrays are bound from this unit upward; unit 0 keeps the single sampler2D
+constexpr GLuint TEXTURE_ARRAY_UNIT = 1;
+
+// must match the size of uTextureArrays in the fragment shader
+constexpr GLuint MAX_TEXTURE_ARRAYS = 8;
+
+// a texture slot names an array (high 16 bits) and a layer in it (low 16 bits)
+inline GLuint UTextureSlot(GLuint array, GLuint layer) { return (array << 16) | layer; }
+inline GLuint UTextureSlotArray(GLuint slot) { return slot >> 16; }
+
+// copies of the scene's 2D textures packed into one GL_TEXTURE_2D_ARRAY per size and
+// format, so every draw can pick its texture from a per-draw slot instead of a bind
+class TextureArraySet
+{
+public:
+	// (re)builds the arrays from these textures; duplicates are ignored. Fails if
+	// the textures need more than MAX_TEXTURE_ARRAYS different sizes or formats
+	bool Build(const std::vector<GLuint>& textures);
+
+	// slot of a texture passed to Build, or 0 (first layer of the first array)
+	GLuint Slot(GLuint textureId) const;
+
+	// binds every array to its unit, starting at TEXTURE_ARRAY_UNIT
+	void Bind() const;
+
+	size_t Arrays() const { return arrays.size(); }
+	size_t Layers() const { return slots.size(); }
+
+	void Destroy();
+
+private:
+	struct Array
+	{
+		GLint width = 0;
+		GLint height = 0;
+		GLint format = 0;
+		std::vector<GLuint> sources;
+		GLuint id = 0;
+	};
+
+	std::vector<Array> arrays;
+	std::unordered_map<GLuint, GLuint> slots;
+};
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include <stb_image.h>      // Image loading Utility functions
+
+#include "TextureCache.h"
+#include "StateCache.h"
+
+using namespace std;
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
+static void flipImageVertically(unsigned char *image, int width, int height, int channels)
+{
+	for (int j = 0; j < height / 2; ++j)
+	{
+		int index1 = j * width * channels;
+		int index2 = (height - 1 - j) * width * channels;
+
+		for (int i = width * channels; i > 0; --i)
+		{
+			unsigned char tmp = image[index1];
+			image[index1] = image[index2];
+			image[index2] = tmp;
+			++index1;
+			++index2;
+		}
+	}
+}
+
+bool TextureCache::Acquire(const char* filename, GLuint& textureId)
+{
+	++requests;
+
+	// seen this path before: no need to touch the file at all
+	const string path = CanonicalPath(filename);
+	auto known = paths.find(path);
+	if (known != paths.end())
+	{
+		Entry& entry = textures[known->second];
+		++entry.references;
+		textureId = entry.id;
+		return true;
+	}
+
+	// baked ahead of time: nothing to decode
+	uint64_t hash = 0;
+	if (AcquireBaked(filename, hash))
+	{
+		paths[path] = hash;
+		Entry& entry = textures[hash];
+		++entry.references;
+		textureId = entry.id;
+		return true;
+	}
+
+	ifstream file(filename, ios::binary);
+	if (!file)
+		return false;
+	const string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	++fileReads;
+	imageFileBytes += bytes.size();
+
+	// a new name for an image that is already loaded
+	hash = HashContents(bytes.data(), bytes.size());
+	auto loaded = textures.find(hash);
+	if (loaded == textures.end())
+	{
+		Entry entry;
+		Image image;
+		image.hash = hash;
+		image.filename = filename;
+
+		if (workers)
+		{
+			// 1x1 mid grey until the real image arrives; the id never changes, so
+			// nothing that already holds it has to be told about the swap
+			const unsigned char grey[] = { 128, 128, 128 };
+			image.pixels = (unsigned char*)grey;
+			image.width = image.height = 1;
+			image.channels = 3;
+			Upload(image, entry);
+			entry.pending = true;
+			++pending;
+
+			workers->Submit([this, image, bytes]() mutable
+			{
+				Decode(bytes, image);
+				lock_guard<mutex> lock(finishedMutex);
+				finished.push_back(image);
+			});
+		}
+		else
+		{
+			Decode(bytes, image);
+			decodeMilliseconds += image.decodeMilliseconds;
+			const auto start = chrono::steady_clock::now();
+			const bool uploaded = Upload(image, entry);
+			uploadMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			stbi_image_free(image.pixels);
+			if (!uploaded)
+				return false;
+		}
+		++decodes;
+
+		loaded = textures.emplace(hash, entry).first;
+		owners[entry.id] = hash;
+	}
+
+	paths[path] = hash;
+	++loaded->second.references;
+	textureId = loaded->second.id;
+	return true;
+}
+
+size_t TextureCache::Update()
+{
+	vector<Image> ready;
+	{
+		lock_guard<mutex> lock(finishedMutex);
+		ready.swap(finished);
+	}
+
+	for (auto& image : ready)
+	{
+		auto texture = textures.find(image.hash);
+		if (texture != textures.end() && texture->second.pending)
+		{
+			// a failed decode leaves the placeholder in place
+			decodeMilliseconds += image.decodeMilliseconds;
+			const auto start = chrono::steady_clock::now();
+			if (!Upload(image, texture->second))
+				cout << "Failed to load texture " << image.filename << endl;
+			uploadMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			texture->second.pending = false;
+			--pending;
+		}
+		// otherwise the last user let go while it was decoding
+
+		stbi_image_free(image.pixels);
+	}
+	return ready.size();
+}
+
+void TextureCache::Release(GLuint textureId)
+{
+	auto owner = owners.find(textureId);
+	if (owner == owners.end())
+		return;
+
+	const uint64_t hash = owner->second;
+	Entry& entry = textures[hash];
+	if (--entry.references > 0)
+		return;
+
+	if (entry.pending)
+		--pending;
+	UStateCache().DeleteTextures(1, &entry.id);
+	textures.erase(hash);
+	owners.erase(owner);
+
+	// forget every name that pointed at the image
+	for (auto it = paths.begin(); it != paths.end();)
+	{
+		if (it->second == hash)
+			it = paths.erase(it);
+		else
+			++it;
+	}
+}
+
+size_t TextureCache::ResidentBytes() const
+{
+	size_t total = 0;
+	for (const auto& texture : textures)
+		total += texture.second.bytes;
+	return total;
+}
+
+void TextureCache::ReportStats(ostream& out) const
+{
+	out << "INFO: Textures: " << requests << " requests, " << fileReads << " files read, "
+		<< decodes << " decoded, " << UniqueTextures() << " resident ("
+		<< ResidentBytes() / 1024 << " KiB)" << endl;
+	out << "INFO: Texture loading: " << bakedLoads << " baked KTX2 (" << bakedFileBytes / 1024 << " KiB mapped, "
+		<< bakedMilliseconds << " ms to map and upload), " << decodes << " PNG/JPG (" << imageFileBytes / 1024 << " KiB read, "
+		<< decodeMilliseconds << " ms decoding, " << uploadMilliseconds << " ms uploading)" << endl;
+}
+
+void TextureCache::Clear()
+{
+	for (auto& texture : textures)
+		UStateCache().DeleteTextures(1, &texture.second.id);
+
+	{
+		lock_guard<mutex> lock(finishedMutex);
+		for (auto& image : finished)
+			stbi_image_free(image.pixels);
+		finished.clear();
+	}
+	pending = 0;
+
+	paths.clear();
+	textures.clear();
+	owners.clear();
+}
+
+string TextureCache::CanonicalPath(const char* filename)
+{
+	// one separator, one case, and no "." or "dir/.." segments
+	string normalized(filename);
+	for (char& c : normalized)
+		c = c == '\\' ? '/' : (char)tolower((unsigned char)c);
+
+	vector<string> segments;
+	stringstream stream(normalized);
+	string segment;
+	while (getline(stream, segment, '/'))
+	{
+		if (segment.empty() || segment == ".")
+			continue;
+		if (segment == ".." && !segments.empty() && segments.back() != "..")
+			segments.pop_back();
+		else
+			segments.push_back(segment);
+	}
+
+	string path;
+	for (const auto& s : segments)
+		path += (path.empty() ? "" : "/") + s;
+	return path;
+}
+
+uint64_t TextureCache::HashContents(const char* bytes, size_t size)
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+string TextureCache::BakedPath(const char* filename)
+{
+	const string path(filename);
+	const size_t dot = path.find_last_of('.');
+	const size_t slash = path.find_last_of("/\\");
+	if (dot == string::npos || (slash != string::npos && dot < slash))
+		return path + ".ktx2";
+	return path.substr(0, dot) + ".ktx2";
+}
+
+bool TextureCache::AcquireBaked(const char* filename, uint64_t& hash)
+{
+	// the baker only writes S3TC formats
+	if (!useBaked || !GLEW_EXT_texture_compression_s3tc)
+		return false;
+
+	const auto start = chrono::steady_clock::now();
+	Ktx2Texture baked;
+	if (!baked.Open(BakedPath(filename)))
+		return false;
+
+	hash = HashContents((const char*)baked.FileData(), baked.FileSize());
+	if (textures.count(hash))
+		return true;
+
+	Entry entry;
+	UploadBaked(baked, entry);
+	textures.emplace(hash, entry);
+	owners[entry.id] = hash;
+
+	++bakedLoads;
+	bakedFileBytes += baked.FileSize();
+	bakedMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+void TextureCache::Decode(const string& bytes, Image& image)
+{
+	const auto start = chrono::steady_clock::now();
+	image.pixels = stbi_load_from_memory((const stbi_uc*)bytes.data(), (int)bytes.size(), &image.width, &image.height, &image.channels, 0);
+	if (image.pixels && (image.channels == 3 || image.channels == 4))
+		flipImageVertically(image.pixels, image.width, image.height, image.channels);
+	image.decodeMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+bool TextureCache::Upload(Image& image, Entry& entry)
+{
+	if (!image.pixels)
+		return false;
+
+	if (image.channels != 3 && image.channels != 4)
+	{
+		cout << "Not implemented to handle image with " << image.channels << " channels (" << image.filename << ")" << endl;
+		return false;
+	}
+
+	if (entry.id == 0)
+		glGenTextures(1, &entry.id);
+	UStateCache().BindTexture(0, GL_TEXTURE_2D, entry.id);
+
+	// set the texture wrapping parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set texture filtering parameters: trilinear, so the mip chain below is read when minifying
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// rows of RGB images are not 4 byte aligned in general
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (image.channels == 3)
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+	else
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	UStateCache().BindTexture(0, GL_TEXTURE_2D, 0); // Unbind the texture
+
+	// RGB8 is padded to four bytes per texel by most drivers; the mip chain adds a third
+	entry.bytes = (size_t)image.width * image.height * 4 * 4 / 3;
+	return true;
+}
+
+void TextureCache::UploadBaked(const Ktx2Texture& baked, Entry& entry)
+{
+	const GLenum format = baked.Format() == KTX2_FORMAT_BC3_UNORM ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	const auto& levels = baked.Levels();
+
+	glGenTextures(1, &entry.id);
+	UStateCache().BindTexture(0, GL_TEXTURE_2D, entry.id);
+
+	// same sampling as the decoded images
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+
+	// the mip chain was filtered by the baker, and the rows are already bottom up
+	entry.bytes = 0;
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, format,
+			max(1u, baked.Width() >> level), max(1u, baked.Height() >> level), 0,
+			(GLsizei)levels[level].size, levels[level].data);
+		entry.bytes += levels[level].size;
+	}
+
+	UStateCache().BindTexture(0, GL_TEXTURE_2D, 0); // Unbind the texture
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+#include "Ktx2File.h"
+#include "ThreadPool.h"
+
+// shares one GL texture between every mesh that uses the same image; files are
+// found by canonical path first and then by a hash of their contents, so the
+// same picture under two names is still decoded and uploaded only once. An image
+// with a baked KTX2 next to it ("name.ktx2" for "name.png") is loaded from that
+// instead: mapped and uploaded block-compressed with its mip chain, nothing decoded
+class TextureCache
+{
+public:
+	// decode new images on these workers; until then Acquire decodes in place
+	void SetWorkers(ThreadPool* pool) { workers = pool; }
+
+	// off: always decode the PNG/JPG, as before the baker (for comparing the two)
+	void SetBakedTextures(bool enabled) { useBaked = enabled; }
+
+	// returns a texture for filename, loading it on first use; every successful
+	// Acquire must be matched by a Release of the same id. With workers the id
+	// holds a 1x1 placeholder until Update uploads the decoded image into it
+	bool Acquire(const char* filename, GLuint& textureId);
+
+	// uploads the images the workers have finished since the last call; GL thread only
+	size_t Update();
+
+	// images still being decoded
+	size_t Pending() const { return pending; }
+
+	// drops one reference; the GL texture is deleted with the last one
+	void Release(GLuint textureId);
+
+	// number of GL textures currently alive (one per unique image)
+	size_t UniqueTextures() const { return textures.size(); }
+
+	// bytes of texture storage held by the cache, mipmaps included
+	size_t ResidentBytes() const;
+
+	void ReportStats(std::ostream& out) const;
+
+	// deletes every texture regardless of outstanding references
+	void Clear();
+
+private:
+	struct Entry
+	{
+		GLuint id = 0;
+		unsigned references = 0;
+		size_t bytes = 0;
+		bool pending = false;
+	};
+
+	// pixels decoded off the GL thread, waiting for Update
+	struct Image
+	{
+		uint64_t hash = 0;
+		std::string filename;
+		unsigned char* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		double decodeMilliseconds = 0.0;
+	};
+
+	// path as written by the caller -> normalized path -> content hash -> texture
+	static std::string CanonicalPath(const char* filename);
+	static uint64_t HashContents(const char* bytes, size_t size);
+
+	// "dir/name.png" -> "dir/name.ktx2"
+	static std::string BakedPath(const char* filename);
+
+	// the texture of filename's baked KTX2 into hash, uploaded if it is new; false
+	// when there is no usable baked file
+	bool AcquireBaked(const char* filename, uint64_t& hash);
+	static void UploadBaked(const Ktx2Texture& baked, Entry& entry);
+
+	// Decode is safe on any thread; Upload needs the GL context
+	static void Decode(const std::string& bytes, Image& image);
+	static bool Upload(Image& image, Entry& entry);
+
+	std::unordered_map<std::string, uint64_t> paths;
+	std::unordered_map<uint64_t, Entry> textures;
+	std::unordered_map<GLuint, uint64_t> owners;
+
+	ThreadPool* workers = nullptr;
+	bool useBaked = true;
+	std::mutex finishedMutex;
+	std::vector<Image> finished;
+	size_t pending = 0;
+
+	// totals since startup
+	size_t requests = 0;
+	size_t fileReads = 0;
+	size_t decodes = 0;
+
+	// what each path cost: baked files are mapped and uploaded, the others are read,
+	// decoded (on the workers) and uploaded with glGenerateMipmap
+	size_t bakedLoads = 0;
+	size_t bakedFileBytes = 0;
+	double bakedMilliseconds = 0.0;
+	size_t imageFileBytes = 0;
+	double decodeMilliseconds = 0.0;
+	double uploadMilliseconds = 0.0;
+};
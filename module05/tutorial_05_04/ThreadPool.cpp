@@ -0,0 +1,71 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+void ThreadPool::Create(unsigned threads)
+{
+	// one core stays with the render thread; hardware_concurrency may also report 0
+	if (threads == 0)
+	{
+		const unsigned cores = thread::hardware_concurrency();
+		threads = cores > 1 ? cores - 1 : 1;
+	}
+
+	stopping = false;
+	for (unsigned i = 0; i < threads; ++i)
+		workers.emplace_back(&ThreadPool::Run, this);
+}
+
+void ThreadPool::Submit(function<void()> job)
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		jobs.push_back(move(job));
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	unique_lock<mutex> lock(queueMutex);
+	idle.wait(lock, [this] { return jobs.empty() && running == 0; });
+}
+
+void ThreadPool::Destroy()
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void ThreadPool::Run()
+{
+	for (;;)
+	{
+		function<void()> job;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;		// stopping, and nothing left to do
+
+			job = move(jobs.front());
+			jobs.pop_front();
+			++running;
+		}
+
+		job();
+
+		{
+			lock_guard<mutex> lock(queueMutex);
+			--running;
+		}
+		idle.notify_all();
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// general includes
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads running queued jobs in submission order;
+// jobs must not touch GL, which stays on the main thread
+class ThreadPool
+{
+public:
+	~ThreadPool() { Destroy(); }
+
+	// starts the workers; 0 picks one per hardware thread, less the main thread
+	void Create(unsigned threads = 0);
+
+	void Submit(std::function<void()> job);
+
+	// blocks until the queue is empty and no job is running
+	void Wait();
+
+	// finishes the queued jobs and joins the workers
+	void Destroy();
+
+	size_t Threads() const { return workers.size(); }
+
+private:
+	void Run();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex queueMutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	size_t running = 0;
+	bool stopping = false;
+};
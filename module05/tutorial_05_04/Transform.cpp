@@ -0,0 +1,30 @@
+#include "Transform.h"
+
+glm::mat4 UAffineInverse(const glm::mat4& m)
+{
+	// the inverse-transpose of the 3x3 part, transposed back
+	const glm::mat3 inverse = glm::transpose(UNormalMatrix(m));
+	const glm::vec3 translation = -(inverse * glm::vec3(m[3]));
+
+	glm::mat4 result(inverse);
+	result[3] = glm::vec4(translation, 1.0f);
+	return result;
+}
+
+glm::mat3 UNormalMatrix(const glm::mat4& model)
+{
+	const glm::vec3 a(model[0]);
+	const glm::vec3 b(model[1]);
+	const glm::vec3 c(model[2]);
+
+	// columns of the cofactor matrix are the cross products of the other two columns
+	const glm::vec3 bc = glm::cross(b, c);
+	const glm::vec3 ca = glm::cross(c, a);
+	const glm::vec3 ab = glm::cross(a, b);
+
+	const float determinant = glm::dot(a, bc);
+	if (determinant == 0.0f)
+		return glm::mat3(1.0f);		// flattened by a zero scale; nothing sensible to light
+
+	return glm::mat3(bc, ca, ab) * (1.0f / determinant);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+// inverse of a matrix whose last row is (0, 0, 0, 1): inverts the 3x3 part and
+// moves the translation back through it, instead of a general 4x4 inverse
+glm::mat4 UAffineInverse(const glm::mat4& m);
+
+// transpose(inverse(mat3(model))) for an affine model matrix, built from the
+// cofactors of the 3x3 part; the one matrix normals need per object
+glm::mat3 UNormalMatrix(const glm::mat4& model);
@@ -0,0 +1,32 @@
+#include "UniformBuffer.h"
+
+void FrameUniformBuffer::Create()
+{
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, ubo);
+}
+
+void FrameUniformBuffer::Update(const FrameData& data)
+{
+	GLintptr offset;
+	if (ring && ring->Write(&data, sizeof(FrameData), ring->UniformAlignment(), offset))
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, ring->Buffer(), offset, sizeof(FrameData));
+		return;
+	}
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniformBuffer::Destroy()
+{
+	glDeleteBuffers(1, &ubo);
+	ubo = 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// glew includes
+#include <GL/glew.h>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "ShaderProgram.h"
+#include "UploadRing.h"
+
+// CPU mirror of the std140 FrameData block; vec3 values are padded to vec4
+struct FrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 objectColor;
+	glm::vec4 lightColor;
+	glm::vec4 lightPosition;
+	glm::vec4 viewPosition;
+	glm::vec4 positionOffset;	// GeometryPool::Decode
+	glm::vec4 positionScale;
+	glm::vec4 texCoordDecode;
+	glm::mat4 lampModel;		// the spot light gizmo, which moves every frame
+	glm::vec4 clusterScale;		// LightClusters::Scale
+	glm::uvec4 clusterSize;		// LightClusters::Size
+	glm::vec4 keyLightDirection;	// towards the key light, intensity in w
+	glm::mat4 shadowMatrix;			// ShadowMap::ShadowMatrix
+	glm::vec4 shadowParams;			// enabled, PCF radius, texel size, depth bias
+};
+
+// uniform buffer holding the data that is the same for every draw of a frame
+class FrameUniformBuffer
+{
+public:
+	// creates the buffer and attaches it to FRAME_DATA_BINDING
+	void Create();
+
+	// frames are written into the ring when one is set, and into the buffer's own storage
+	// only when the ring has no room
+	void SetUploadRing(UploadRing* uploadRing) { ring = uploadRing; }
+
+	// uploads the frame's data once, before any mesh is drawn
+	void Update(const FrameData& data);
+
+	void Destroy();
+
+private:
+	GLuint ubo = 0;
+	UploadRing* ring = nullptr;
+};
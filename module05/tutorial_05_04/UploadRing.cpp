@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "UploadRing.h"
+
+using namespace std;
+
+bool UploadRing::Create(size_t size)
+{
+	capacity = size;
+
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment > 0)
+		uniformAlignment = (size_t)alignment;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment > 0)
+		storageAlignment = (size_t)alignment;
+
+	// mapped once for the lifetime of the buffer; coherent, so writes need no flush
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, nullptr, flags);
+	mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (!mapped)
+	{
+		Destroy();
+		return false;
+	}
+	return true;
+}
+
+void UploadRing::BeginFrame()
+{
+	while (frames.size() >= FRAMES_IN_FLIGHT)
+	{
+		if (Retire())
+			++frameWaits;
+	}
+}
+
+void* UploadRing::Allocate(size_t size, size_t alignment, GLintptr& offset)
+{
+	if (!mapped || size == 0)
+		return nullptr;
+
+	// data never wraps inside one allocation; the skipped end of the buffer counts as used
+	size_t start = (head + alignment - 1) / alignment * alignment;
+	if (start + size > capacity)
+		start = 0;
+	const size_t used = (start >= head ? start - head : capacity - head) + size;
+
+	// the frame's own data has to stay intact until it is fenced
+	if (frameBytes + used >= capacity)
+	{
+		++overflows;
+		return nullptr;
+	}
+
+	if (Overlaps(start, size))
+	{
+		// the GPU still reads frames that wrote here: the ring is too small for the frames in flight
+		const auto waitStart = chrono::steady_clock::now();
+		++stalls;
+		while (Overlaps(start, size))
+			Retire();
+		stallMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - waitStart).count();
+	}
+
+	head = start + size;
+	frameBytes += used;
+	offset = (GLintptr)start;
+	return mapped + start;
+}
+
+bool UploadRing::Write(const void* data, size_t size, size_t alignment, GLintptr& offset)
+{
+	void* target = Allocate(size, alignment, offset);
+	if (!target)
+		return false;
+	memcpy(target, data, size);
+	return true;
+}
+
+void UploadRing::EndFrame()
+{
+	if (!mapped)
+		return;
+
+	frames.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frameBegin, head });
+	peakFrameBytes = max(peakFrameBytes, frameBytes);
+	frameBegin = head;
+	frameBytes = 0;
+	++frameCount;
+}
+
+bool UploadRing::Retire()
+{
+	Frame& frame = frames.front();
+
+	GLenum result = glClientWaitSync(frame.fence, 0, 0);
+	const bool waited = result == GL_TIMEOUT_EXPIRED;
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+
+	glDeleteSync(frame.fence);
+	frames.pop_front();
+	return waited;
+}
+
+bool UploadRing::Overlaps(size_t offset, size_t size) const
+{
+	auto overlaps = [offset, size](size_t begin, size_t end) {
+		return offset < end && begin < offset + size;
+	};
+
+	for (const Frame& frame : frames)
+	{
+		if (frame.begin <= frame.end ? overlaps(frame.begin, frame.end)
+			: overlaps(frame.begin, capacity) || overlaps(0, frame.end))
+			return true;
+	}
+	return false;
+}
+
+void UploadRing::Report(ostream& out) const
+{
+	if (!mapped)
+		return;
+
+	out << "INFO: Upload ring: " << capacity / 1024 << " KiB, peak " << (peakFrameBytes + 1023) / 1024 << " KiB per frame, "
+		<< stalls << " stalls on space in use (" << stallMilliseconds << " ms), " << frameWaits << " of "
+		<< frameCount << " frames waited for the GPU, " << overflows << " uploads did not fit" << endl;
+	if (stalls > 0 || overflows > 0)
+		out << "WARNING: the upload ring is undersized for " << FRAMES_IN_FLIGHT << " frames in flight, raise --upload-ring-kib" << endl;
+}
+
+void UploadRing::Destroy()
+{
+	for (Frame& frame : frames)
+		glDeleteSync(frame.fence);
+	frames.clear();
+
+	if (mapped)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	mapped = nullptr;
+	head = frameBegin = frameBytes = 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <deque>
+#include <ostream>
+
+// glew includes
+#include <GL/glew.h>
+
+// one persistently mapped buffer that every frame streams its dynamic data into (frame uniforms,
+// culled draw commands, visible instances). Writes go straight into coherent memory and each
+// frame is fenced, so the CPU fills frame N+1 while the GPU still reads frame N and the driver
+// never has to synchronize a glBufferSubData behind the scenes
+class UploadRing
+{
+public:
+	// frames the CPU may run ahead of the GPU
+	static constexpr size_t FRAMES_IN_FLIGHT = 3;
+
+	// capacity covers every frame in flight; needs GL 4.4 (ARB_buffer_storage)
+	bool Create(size_t capacity);
+
+	// waits until fewer than FRAMES_IN_FLIGHT frames are queued; call before the first Allocate
+	void BeginFrame();
+
+	// room for size bytes, aligned for the target it will be bound to; waits for the GPU when the
+	// space is still being read and returns nullptr when the frame does not fit the ring at all
+	void* Allocate(size_t size, size_t alignment, GLintptr& offset);
+
+	// copies data into the ring; same failure as Allocate
+	bool Write(const void* data, size_t size, size_t alignment, GLintptr& offset);
+
+	// fences everything allocated since BeginFrame
+	void EndFrame();
+
+	GLuint Buffer() const { return buffer; }
+	size_t Capacity() const { return capacity; }
+
+	// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, for glBindBufferRange
+	size_t UniformAlignment() const { return uniformAlignment; }
+
+	// GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+	size_t StorageAlignment() const { return storageAlignment; }
+
+	// waits for space the GPU had not finished with (the ring is undersized), waits for the
+	// frame limit, and allocations that were bigger than what a frame can have
+	size_t Stalls() const { return stalls; }
+	double StallMilliseconds() const { return stallMilliseconds; }
+	size_t FrameWaits() const { return frameWaits; }
+	size_t Overflows() const { return overflows; }
+
+	void Report(std::ostream& out) const;
+
+	void Destroy();
+
+private:
+	// a frame's data runs from begin to end, wrapping past the end of the buffer when end < begin
+	struct Frame
+	{
+		GLsync fence;
+		size_t begin;
+		size_t end;
+	};
+
+	// blocks on the oldest queued frame and releases its space; returns whether it had to wait
+	bool Retire();
+
+	// whether [offset, offset + size) holds data of a queued frame
+	bool Overlaps(size_t offset, size_t size) const;
+
+	GLuint buffer = 0;
+	uint8_t* mapped = nullptr;
+	size_t capacity = 0;
+	size_t uniformAlignment = 256;
+	size_t storageAlignment = 256;
+
+	std::deque<Frame> frames;
+	size_t head = 0;
+	size_t frameBegin = 0;
+	size_t frameBytes = 0;		// including what wrapping skipped
+	size_t peakFrameBytes = 0;
+
+	size_t stalls = 0;
+	double stallMilliseconds = 0.0;
+	size_t frameWaits = 0;
+	size_t overflows = 0;
+	size_t frameCount = 0;
+};
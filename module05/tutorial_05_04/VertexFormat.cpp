@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include <glm/gtc/packing.hpp>
+
+#include "VertexFormat.h"
+
+using namespace std;
+
+namespace
+{
+// where each part of an authored vertex starts, in floats
+constexpr size_t POSITION_FLOAT = 0;
+constexpr size_t NORMAL_FLOAT = 3;
+constexpr size_t TEXCOORD_FLOAT = 7;
+
+const VertexFormat FORMATS[VERTEX_FORMAT_COUNT] = {
+	{ "float", 36,
+		{ 3, GL_FLOAT, GL_FALSE, 0 },
+		{ 3, GL_FLOAT, GL_FALSE, 12 },
+		{ 2, GL_FLOAT, GL_FALSE, 28 } },
+	{ "half", 16,
+		{ 3, GL_HALF_FLOAT, GL_FALSE, 0 },	// fourth half is padding
+		{ 4, GL_INT_2_10_10_10_REV, GL_TRUE, 8 },
+		{ 2, GL_HALF_FLOAT, GL_FALSE, 12 } },
+	{ "unorm16", 16,
+		{ 3, GL_UNSIGNED_SHORT, GL_TRUE, 0 },
+		{ 4, GL_INT_2_10_10_10_REV, GL_TRUE, 8 },
+		{ 2, GL_UNSIGNED_SHORT, GL_TRUE, 12 } }
+};
+
+// the packed formats share one 16 byte layout
+struct PackedVertex
+{
+	uint16_t position[4];
+	uint32_t normal;
+	uint16_t texCoord[2];
+};
+static_assert(sizeof(PackedVertex) == 16, "packed vertex must match the format descriptors");
+
+uint16_t UPackComponent(VertexFormatId format, float value, float offset, float scale)
+{
+	if (format == VERTEX_FORMAT_HALF)
+		return glm::packHalf1x16(value);
+	return glm::packUnorm1x16((value - offset) / scale);
+}
+
+float UUnpackComponent(VertexFormatId format, uint16_t value, float offset, float scale)
+{
+	if (format == VERTEX_FORMAT_HALF)
+		return glm::unpackHalf1x16(value);
+	return offset + glm::unpackUnorm1x16(value) * scale;
+}
+
+// half a half-float ulp at the largest magnitude in the range
+float UHalfError(float largest)
+{
+	if (largest <= 0.0f)
+		return 0.0f;
+	int exponent;
+	frexp(largest, &exponent);
+	return ldexp(1.0f, exponent - 1 - 10) * 0.5f;
+}
+}
+
+const VertexFormat& UVertexFormat(VertexFormatId format)
+{
+	return FORMATS[format];
+}
+
+bool UParseVertexFormat(const string& name, VertexFormatId& format)
+{
+	for (int i = 0; i < VERTEX_FORMAT_COUNT; ++i)
+	{
+		if (name == FORMATS[i].name)
+		{
+			format = (VertexFormatId)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+VertexDecode UComputeVertexDecode(VertexFormatId format, const vector<float>& vertices, size_t floatsPerVertex)
+{
+	VertexDecode decode;
+	if (format != VERTEX_FORMAT_UNORM16 || vertices.empty())
+		return decode;
+
+	glm::vec3 positionMin(FLT_MAX), positionMax(-FLT_MAX);
+	glm::vec2 texCoordMin(FLT_MAX), texCoordMax(-FLT_MAX);
+	for (size_t i = 0; i < vertices.size(); i += floatsPerVertex)
+	{
+		const glm::vec3 position(vertices[i + POSITION_FLOAT], vertices[i + POSITION_FLOAT + 1], vertices[i + POSITION_FLOAT + 2]);
+		const glm::vec2 texCoord(vertices[i + TEXCOORD_FLOAT], vertices[i + TEXCOORD_FLOAT + 1]);
+		positionMin = glm::min(positionMin, position);
+		positionMax = glm::max(positionMax, position);
+		texCoordMin = glm::min(texCoordMin, texCoord);
+		texCoordMax = glm::max(texCoordMax, texCoord);
+	}
+
+	// a flat axis still needs a scale that can be divided by
+	const glm::vec3 positionExtent = glm::max(positionMax - positionMin, glm::vec3(FLT_MIN));
+	const glm::vec2 texCoordExtent = glm::max(texCoordMax - texCoordMin, glm::vec2(FLT_MIN));
+	decode.positionOffset = glm::vec4(positionMin, 0.0f);
+	decode.positionScale = glm::vec4(positionExtent, 1.0f);
+	decode.texCoordDecode = glm::vec4(texCoordMin, texCoordExtent);
+	return decode;
+}
+
+void UEncodeVertices(VertexFormatId format, const VertexDecode& decode,
+	const vector<float>& vertices, size_t floatsPerVertex, vector<uint8_t>& encoded)
+{
+	const size_t count = vertices.size() / floatsPerVertex;
+	if (format == VERTEX_FORMAT_FLOAT)
+	{
+		// the authored layout as it is
+		encoded.resize(vertices.size() * sizeof(float));
+		memcpy(encoded.data(), vertices.data(), encoded.size());
+		return;
+	}
+
+	encoded.resize(count * sizeof(PackedVertex));
+	PackedVertex* out = (PackedVertex*)encoded.data();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float* in = &vertices[i * floatsPerVertex];
+		for (int c = 0; c < 3; ++c)
+			out[i].position[c] = UPackComponent(format, in[POSITION_FLOAT + c], decode.positionOffset[c], decode.positionScale[c]);
+		out[i].position[3] = 0;
+
+		out[i].normal = glm::packSnorm3x10_1x2(glm::vec4(in[NORMAL_FLOAT], in[NORMAL_FLOAT + 1], in[NORMAL_FLOAT + 2], 0.0f));
+
+		for (int c = 0; c < 2; ++c)
+			out[i].texCoord[c] = UPackComponent(format, in[TEXCOORD_FLOAT + c], decode.texCoordDecode[c], decode.texCoordDecode[2 + c]);
+	}
+}
+
+VertexError UMeasureVertexError(VertexFormatId format, const VertexDecode& decode,
+	const vector<float>& vertices, size_t floatsPerVertex, const vector<uint8_t>& encoded)
+{
+	VertexError error;
+	if (format == VERTEX_FORMAT_FLOAT)
+		return error;
+
+	const size_t count = vertices.size() / floatsPerVertex;
+	const PackedVertex* packed = (const PackedVertex*)encoded.data();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float* in = &vertices[i * floatsPerVertex];
+		const glm::vec4 normal = glm::unpackSnorm3x10_1x2(packed[i].normal);
+		for (int c = 0; c < 3; ++c)
+		{
+			const float position = UUnpackComponent(format, packed[i].position[c], decode.positionOffset[c], decode.positionScale[c]);
+			error.position = max(error.position, fabs(position - in[POSITION_FLOAT + c]));
+			error.normal = max(error.normal, fabs(normal[c] - in[NORMAL_FLOAT + c]));
+		}
+		for (int c = 0; c < 2; ++c)
+		{
+			const float texCoord = UUnpackComponent(format, packed[i].texCoord[c], decode.texCoordDecode[c], decode.texCoordDecode[2 + c]);
+			error.texCoord = max(error.texCoord, fabs(texCoord - in[TEXCOORD_FLOAT + c]));
+		}
+	}
+	return error;
+}
+
+VertexError UVertexErrorBound(VertexFormatId format, const VertexDecode& decode,
+	const vector<float>& vertices, size_t floatsPerVertex)
+{
+	VertexError bound;
+	if (format == VERTEX_FORMAT_FLOAT)
+		return bound;
+
+	// snorm10 steps are 1/511
+	bound.normal = 0.5f / 511.0f;
+
+	if (format == VERTEX_FORMAT_UNORM16)
+	{
+		const glm::vec3 positionScale(decode.positionScale);
+		bound.position = max(positionScale.x, max(positionScale.y, positionScale.z)) * 0.5f / 65535.0f;
+		bound.texCoord = max(decode.texCoordDecode.z, decode.texCoordDecode.w) * 0.5f / 65535.0f;
+	}
+	else
+	{
+		float position = 0.0f, texCoord = 0.0f;
+		for (size_t i = 0; i < vertices.size(); i += floatsPerVertex)
+		{
+			for (int c = 0; c < 3; ++c)
+				position = max(position, fabs(vertices[i + POSITION_FLOAT + c]));
+			for (int c = 0; c < 2; ++c)
+				texCoord = max(texCoord, fabs(vertices[i + TEXCOORD_FLOAT + c]));
+		}
+		bound.position = UHalfError(position);
+		bound.texCoord = UHalfError(texCoord);
+	}
+
+	// room for the float arithmetic of decoding
+	bound.position = bound.position * 1.001f + 1e-7f;
+	bound.normal = bound.normal * 1.001f + 1e-7f;
+	bound.texCoord = bound.texCoord * 1.001f + 1e-7f;
+	return bound;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// general includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// glew includes
+#include <GL/glew.h>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+// layouts the geometry pool can store its vertices in; the CPU side always keeps ShapeCreator's
+// interleaved floats (position, color/normal, UV) and only the GPU copy is packed
+enum VertexFormatId
+{
+	VERTEX_FORMAT_FLOAT = 0,	// 36 bytes: everything as float
+	VERTEX_FORMAT_HALF,			// 16 bytes: half position and UV, 2_10_10_10 normal
+	VERTEX_FORMAT_UNORM16,		// 16 bytes: unorm16 position and UV within the pool bounds, 2_10_10_10 normal
+	VERTEX_FORMAT_COUNT
+};
+
+// one attribute as glVertexAttribPointer takes it
+struct VertexAttribute
+{
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLuint offset;
+};
+
+// everything BindVertexLayout needs to know about a format
+struct VertexFormat
+{
+	const char* name;
+	GLsizei stride;
+	VertexAttribute position;	// location 0
+	VertexAttribute normal;		// location 1, holds a color for the round shapes
+	VertexAttribute texCoord;	// location 2
+};
+
+// maps what the attributes deliver back to the authored values (identity unless unorm16); the
+// vertex shaders apply it through the frame uniforms
+struct VertexDecode
+{
+	glm::vec4 positionOffset = glm::vec4(0.0f);
+	glm::vec4 positionScale = glm::vec4(1.0f);
+	glm::vec4 texCoordDecode = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);	// offset in xy, scale in zw
+};
+
+// largest difference between the authored floats and what the shader ends up with
+struct VertexError
+{
+	float position = 0.0f;
+	float normal = 0.0f;
+	float texCoord = 0.0f;
+};
+
+const VertexFormat& UVertexFormat(VertexFormatId format);
+
+// "float", "half" or "unorm16"
+bool UParseVertexFormat(const std::string& name, VertexFormatId& format);
+
+// the unorm16 ranges cover every vertex given
+VertexDecode UComputeVertexDecode(VertexFormatId format, const std::vector<float>& vertices, size_t floatsPerVertex);
+
+void UEncodeVertices(VertexFormatId format, const VertexDecode& decode,
+	const std::vector<float>& vertices, size_t floatsPerVertex, std::vector<uint8_t>& encoded);
+
+// decodes the packed data the way the GPU and the vertex shader do and compares it with the floats
+VertexError UMeasureVertexError(VertexFormatId format, const VertexDecode& decode,
+	const std::vector<float>& vertices, size_t floatsPerVertex, const std::vector<uint8_t>& encoded);
+
+// worst case error of the format, for the same vertices: half a quantization step, or half a
+// half-float ulp at the largest magnitude
+VertexError UVertexErrorBound(VertexFormatId format, const VertexDecode& decode,
+	const std::vector<float>& vertices, size_t floatsPerVertex);
@@ -0,0 +1,8 @@
+#version 440 core
+
+// Depth-only Fragment Shader, for the shadow pass and the depth prepass
+
+void main()
+{
+    // only depth is written
+}
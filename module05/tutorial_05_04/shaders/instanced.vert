@@ -0,0 +1,56 @@
+#version 440 core
+
+// Instanced Vertex Shader
+
+layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout (location = 1) in vec3 normal; // VAP position 1 for normals
+layout (location = 2) in vec2 textureCoordinate;
+
+// Per-instance data, advanced once per instance (the model matrix takes locations 3 to 6)
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in mat3 instanceNormalMatrix; // takes locations 7 to 9
+layout (location = 10) in vec2 instanceUVScale;
+layout (location = 11) in uint instanceTextureSlot;
+
+out vec3 vertexNormal; // For outgoing normals to fragment shader
+out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+out vec2 vertexTextureCoordinate;
+flat out vec2 vertexUVScale;
+flat out uint vertexTextureSlot;
+
+// Per-frame data, written once per frame into a uniform buffer
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 objectColor;
+    vec4 lightColor;
+    vec4 lightPos;
+    vec4 viewPosition;
+    vec4 positionOffset; // decodes the pool's packed vertices, see VertexFormat.h
+    vec4 positionScale;
+    vec4 texCoordDecode; // offset in xy, scale in zw
+    mat4 lampModel; // the orbiting spot light gizmo
+    vec4 clusterScale; // tiles per pixel in xy, log depth to slice in zw
+    uvec4 clusterSize; // clusters per axis, light count in w
+    vec4 keyLightDirection; // towards the key light, intensity in w
+    mat4 shadowMatrix; // world to key light shadow map
+    vec4 shadowParams; // enabled, PCF radius, texel size, depth bias
+};
+
+// the depth prepass draws with the same transform; depth has to come out bit for bit equal
+invariant gl_Position;
+
+void main()
+{
+    vec3 localPosition = positionOffset.xyz + position * positionScale.xyz; // back to mesh space from the packed format
+
+    gl_Position = projection * view * instanceModel * vec4(localPosition, 1.0f); // Transforms vertices into clip coordinates
+
+    vertexFragmentPos = vec3(instanceModel * vec4(localPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = instanceNormalMatrix * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexTextureCoordinate = texCoordDecode.xy + textureCoordinate * texCoordDecode.zw;
+    vertexUVScale = instanceUVScale;
+    vertexTextureSlot = instanceTextureSlot;
+}
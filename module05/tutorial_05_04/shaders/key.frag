@@ -0,0 +1,148 @@
+#version 440 core
+
+// Cube Fragment Shader
+
+in vec3 vertexNormal; // For incoming normals
+in vec3 vertexFragmentPos; // For incoming fragment position
+in vec2 vertexTextureCoordinate;
+flat in vec2 vertexUVScale;
+flat in uint vertexTextureSlot;
+
+out vec4 fragmentColor; // For outgoing cube color to the GPU
+
+// Per-frame object color, light color, light position, and camera/view position
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 objectColor;
+    vec4 lightColor;
+    vec4 lightPos;
+    vec4 viewPosition;
+    vec4 positionOffset; // decodes the pool's packed vertices, see VertexFormat.h
+    vec4 positionScale;
+    vec4 texCoordDecode; // offset in xy, scale in zw
+    mat4 lampModel; // the orbiting spot light gizmo
+    vec4 clusterScale; // tiles per pixel in xy, log depth to slice in zw
+    uvec4 clusterSize; // clusters per axis, light count in w
+    vec4 keyLightDirection; // towards the key light, intensity in w
+    mat4 shadowMatrix; // world to key light shadow map
+    vec4 shadowParams; // enabled, PCF radius, texel size, depth bias
+};
+
+// Point lights and the clusters of the view frustum they reach, see LightClusters.h
+struct PointLight
+{
+    vec4 positionRadius;
+    vec4 color;
+};
+
+layout (std430, binding = 1) readonly buffer LightBuffer
+{
+    PointLight lights[];
+};
+
+layout (std430, binding = 2) readonly buffer ClusterBuffer
+{
+    uvec2 clusters[]; // offset and count into lightIndices
+};
+
+layout (std430, binding = 3) readonly buffer LightIndexBuffer
+{
+    uint lightIndices[];
+};
+
+uniform sampler2D uTexture; // Useful when working with multiple textures
+
+// Depth of the key light's shadow casters, compared in hardware
+uniform sampler2DShadow uShadowMap;
+
+// Texture arrays, one per texture size; the slot holds the array and the layer. A sampler array
+// needs a dynamically uniform index, so the array comes from a uniform set per multi-draw (every
+// draw in it shares the array) and only the layer from the slot
+uniform sampler2DArray uTextureArrays[8];
+uniform uint textureArray;
+uniform bool useTextureArrays;
+
+void main()
+{
+    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+
+    //Calculate Ambient lighting*/
+    float ambientStrength = 0.4f; // Set ambient or global lighting strength
+    vec3 ambient = ambientStrength * lightColor.rgb; // Generate ambient light color
+
+    //Calculate Diffuse lighting*/
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+    vec3 lightDirection = normalize(lightPos.xyz - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+    float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
+    vec3 diffuse = impact * lightColor.rgb; // Generate diffuse light color
+
+    //Calculate Specular lighting*/
+    float specularIntensity = 0.8f; // Set specular light strength
+    float highlightSize = 16.0f; // Set specular highlight size
+    vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos); // Calculate view direction
+    vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+    //Calculate specular component
+    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+    vec3 specular = specularIntensity * specularComponent * lightColor.rgb;
+
+    // Key light, a directional light shadowed by the cached shadow map
+    float keyVisibility = 1.0f;
+    if (shadowParams.x > 0.5f)
+    {
+        vec4 shadowCoordinate = shadowMatrix * vec4(vertexFragmentPos, 1.0f);
+        vec3 shadowPosition = shadowCoordinate.xyz / shadowCoordinate.w;
+        if (all(lessThanEqual(abs(shadowPosition - 0.5f), vec3(0.5f))))
+        {
+            // percentage closer filtering over a square kernel
+            int pcfRadius = int(shadowParams.y);
+            float lit = 0.0f;
+            for (int y = -pcfRadius; y <= pcfRadius; ++y)
+            {
+                for (int x = -pcfRadius; x <= pcfRadius; ++x)
+                    lit += texture(uShadowMap, vec3(shadowPosition.xy + vec2(x, y) * shadowParams.z, shadowPosition.z - shadowParams.w));
+            }
+            keyVisibility = lit / float((2 * pcfRadius + 1) * (2 * pcfRadius + 1));
+        }
+    }
+    vec3 keyLight = keyLightDirection.w * keyVisibility * max(dot(norm, normalize(keyLightDirection.xyz)), 0.0f) * objectColor.rgb;
+
+    // Point lights, only the ones listed for this fragment's cluster
+    vec3 pointLighting = vec3(0.0f);
+    if (clusterSize.w > 0u)
+    {
+        float viewDepth = max(-(view * vec4(vertexFragmentPos, 1.0f)).z, 0.0001f);
+        ivec3 cell = ivec3(ivec2(gl_FragCoord.xy * clusterScale.xy), int(floor(log(viewDepth) * clusterScale.z + clusterScale.w)));
+        cell = clamp(cell, ivec3(0), ivec3(clusterSize.xyz) - 1);
+        uvec2 cluster = clusters[(cell.z * int(clusterSize.y) + cell.y) * int(clusterSize.x) + cell.x];
+
+        for (uint i = cluster.x; i < cluster.x + cluster.y; ++i)
+        {
+            PointLight light = lights[lightIndices[i]];
+            vec3 toLight = light.positionRadius.xyz - vertexFragmentPos;
+            float lightDistance = length(toLight);
+            vec3 pointDirection = toLight / max(lightDistance, 0.0001f);
+
+            // inverse square falloff, windowed to reach zero at the light's radius
+            float window = clamp(1.0f - pow(lightDistance / light.positionRadius.w, 4.0f), 0.0f, 1.0f);
+            float attenuation = window * window / (lightDistance * lightDistance + 1.0f);
+
+            float pointImpact = max(dot(norm, pointDirection), 0.0f);
+            float pointSpecular = pow(max(dot(viewDir, reflect(-pointDirection, norm)), 0.0f), highlightSize);
+            pointLighting += attenuation * (pointImpact + specularIntensity * pointSpecular) * light.color.rgb;
+        }
+    }
+
+    // Texture holds the color to be used for all three components
+    vec4 textureColor;
+    if (useTextureArrays)
+        textureColor = texture(uTextureArrays[textureArray], vec3(vertexTextureCoordinate * vertexUVScale, float(vertexTextureSlot & 0xFFFFu)));
+    else
+        textureColor = texture(uTexture, vertexTextureCoordinate * vertexUVScale);
+
+    // Calculate phong result
+    vec3 phong = (ambient + diffuse + specular + keyLight + pointLighting) * textureColor.xyz;
+
+    fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+}
@@ -0,0 +1,70 @@
+#version 440 core
+#extension GL_ARB_shader_draw_parameters : require
+
+// Cube Vertex Shader
+
+layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout (location = 1) in vec3 normal; // VAP position 1 for normals
+layout (location = 2) in vec2 textureCoordinate;
+
+out vec3 vertexNormal; // For outgoing normals to fragment shader
+out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+out vec2 vertexTextureCoordinate;
+flat out vec2 vertexUVScale;
+flat out uint vertexTextureSlot;
+
+// Per-frame data, written once per frame into a uniform buffer
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 objectColor;
+    vec4 lightColor;
+    vec4 lightPos;
+    vec4 viewPosition;
+    vec4 positionOffset; // decodes the pool's packed vertices, see VertexFormat.h
+    vec4 positionScale;
+    vec4 texCoordDecode; // offset in xy, scale in zw
+    mat4 lampModel; // the orbiting spot light gizmo
+    vec4 clusterScale; // tiles per pixel in xy, log depth to slice in zw
+    uvec4 clusterSize; // clusters per axis, light count in w
+    vec4 keyLightDirection; // towards the key light, intensity in w
+    mat4 shadowMatrix; // world to key light shadow map
+    vec4 shadowParams; // enabled, PCF radius, texel size, depth bias
+};
+
+// Per-draw data of every mesh in the scene, indexed by draw
+struct DrawData
+{
+    mat4 model;
+    mat3 normalMatrix; // inverse-transpose of model, computed once per object on the CPU
+    vec2 uvScale;
+    uint textureSlot;
+    uint padding;
+};
+
+layout (std430, binding = 0) readonly buffer DrawBuffer
+{
+    DrawData draws[];
+};
+
+// the depth prepass draws with the same transform; depth has to come out bit for bit equal
+invariant gl_Position;
+
+void main()
+{
+    // every indirect command carries the index of its draw data as base instance
+    DrawData draw = draws[gl_BaseInstanceARB];
+    mat4 model = draw.model;
+    vertexUVScale = draw.uvScale;
+    vertexTextureSlot = draw.textureSlot;
+
+    vec3 localPosition = positionOffset.xyz + position * positionScale.xyz; // back to mesh space from the packed format
+
+    gl_Position = projection * view * model * vec4(localPosition, 1.0f); // Transforms vertices into clip coordinates
+
+    vertexFragmentPos = vec3(model * vec4(localPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = draw.normalMatrix * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexTextureCoordinate = texCoordDecode.xy + textureCoordinate * texCoordDecode.zw;
+}
@@ -0,0 +1,10 @@
+#version 440 core
+
+// Lamp Fragment Shader
+
+out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
+
+void main()
+{
+    fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
+}
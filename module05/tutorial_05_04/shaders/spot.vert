@@ -0,0 +1,32 @@
+#version 440 core
+
+// Lamp Shader
+
+layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+// Per-frame data shared with the key light program
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 objectColor;
+    vec4 lightColor;
+    vec4 lightPos;
+    vec4 viewPosition;
+    vec4 positionOffset; // decodes the pool's packed vertices, see VertexFormat.h
+    vec4 positionScale;
+    vec4 texCoordDecode; // offset in xy, scale in zw
+    mat4 lampModel; // the orbiting spot light gizmo
+    vec4 clusterScale; // tiles per pixel in xy, log depth to slice in zw
+    uvec4 clusterSize; // clusters per axis, light count in w
+    vec4 keyLightDirection; // towards the key light, intensity in w
+    mat4 shadowMatrix; // world to key light shadow map
+    vec4 shadowParams; // enabled, PCF radius, texel size, depth bias
+};
+
+void main()
+{
+    vec3 localPosition = positionOffset.xyz + position * positionScale.xyz; // back to mesh space from the packed format
+
+    gl_Position = projection * view * lampModel * vec4(localPosition, 1.0f); // Transforms vertices into clip coordinates
+}